@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* 每次分配前的头部，记录长度供 realloc 拷贝 */
+#define ARENA_HDR ARENA_ALIGN
+
+static __thread arena thread_arena;
+static __thread int depth;			/* 作用域嵌套层数，只有最外层 arena_end 回收 */
+
+static size_t align_up(size_t n)
+{
+	return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static arena_chunk *chunk_new(arena *a, size_t need)
+{
+	size_t size = need > ARENA_CHUNK_SIZE / 2 ? need * 2 : ARENA_CHUNK_SIZE;
+	arena_chunk *c = malloc(sizeof(arena_chunk) + size);
+	if (!c)
+		return NULL;
+	c->size = size;
+	c->used = 0;
+	c->next = a->head;
+	a->head = c;
+	return c;
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+	size_t need = ARENA_HDR + align_up(size ? size : 1);
+	arena_chunk *c = a->head;
+	char *p;
+
+	if (!c || c->size - c->used < need) {
+		if (!(c = chunk_new(a, need)))
+			return NULL;
+	}
+	p = c->data + c->used;
+	c->used += need;
+	*(size_t *)p = size;
+	a->last = p + ARENA_HDR;
+	return a->last;
+}
+
+/*保留最早分配的一块，其余归还给 malloc*/
+void arena_reset(arena *a)
+{
+	arena_chunk *c = a->head, *next;
+
+	while (c && c->next) {
+		next = c->next;
+		free(c);
+		c = next;
+	}
+	if (c)
+		c->used = 0;
+	a->head = c;
+	a->last = NULL;
+}
+
+int arena_owns(arena *a, const void *p)
+{
+	for (arena_chunk *c = a->head; c; c = c->next) {
+		if ((const char *)p >= c->data && (const char *)p < c->data + c->size)
+			return 1;
+	}
+	return 0;
+}
+
+/*最后一次分配且块内空间足够时原地扩展，否则重新分配并拷贝*/
+static void *arena_grow(arena *a, char *p, size_t size)
+{
+	size_t old = *(size_t *)(p - ARENA_HDR);
+	arena_chunk *c = a->head;
+	char *n;
+
+	if (p == a->last && p + align_up(size ? size : 1) <= c->data + c->size) {
+		c->used = p - c->data + align_up(size ? size : 1);
+		*(size_t *)(p - ARENA_HDR) = size;
+		return p;
+	}
+	if (!(n = arena_alloc(a, size)))
+		return NULL;
+	memcpy(n, p, old < size ? old : size);
+	return n;
+}
+
+void arena_begin(void)
+{
+	depth++;
+}
+
+void arena_end(void)
+{
+	if (depth > 0 && --depth == 0)
+		arena_reset(&thread_arena);
+}
+
+void *arena_malloc(size_t size)
+{
+	return depth ? arena_alloc(&thread_arena, size) : malloc(size);
+}
+
+/*作用域内分配的内存由 arena_end 统一回收*/
+void arena_free(void *p)
+{
+	if (p && !(depth && arena_owns(&thread_arena, p)))
+		free(p);
+}
+
+void *arena_realloc(void *p, size_t size)
+{
+	if (!p)
+		return arena_malloc(size);
+	if (depth && arena_owns(&thread_arena, p))
+		return arena_grow(&thread_arena, p, size);
+	return realloc(p, size);
+}
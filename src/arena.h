@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE (16 * 1024)	/* 每个线程常驻的首块大小，普通请求用不完 */
+#define ARENA_ALIGN (16)
+
+typedef struct _arena_chunk
+{
+	struct _arena_chunk *next;		/* 更早分配的块 */
+	size_t size;
+	size_t used;
+	char data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_chunk;
+
+/* 顺序分配，不单独释放，arena_reset 时整体回收 */
+typedef struct _arena
+{
+	arena_chunk *head;				/* 当前分配的块 */
+	char *last;						/* 最近一次分配，realloc 时可原地扩展 */
+} arena;
+
+void *arena_alloc(arena *a, size_t size);
+void arena_reset(arena *a);
+int arena_owns(arena *a, const void *p);
+
+/*
+ *  请求作用域：网络线程处理一个请求前调用 arena_begin，应答放入发送缓冲区后调用 arena_end，
+ *  其间经 arena_malloc 的分配（JSON 树、json_dumps 的输出、tool.c 的字符串）一次性回收。
+ *  作用域外 arena_malloc 等同于 malloc。
+ */
+void arena_begin(void);
+void arena_end(void);
+void *arena_malloc(size_t size);
+void arena_free(void *p);
+void *arena_realloc(void *p, size_t size);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "atbuf.h"
+
+static long mem_limit = AT_MEM_LIMIT;
+static long mem_used = 0;	/* 所有分段占用的内存，原子访问 */
+
+void at_mem_set_limit(long bytes)
+{
+	mem_limit = bytes;
+}
+
+long at_mem_used(void)
+{
+	return __atomic_load_n(&mem_used, __ATOMIC_RELAXED);
+}
+
+at_resp *at_resp_new(void)
+{
+	at_resp *r = calloc(1, sizeof(at_resp));
+	if (r)
+		r->refcnt = 1;
+	return r;
+}
+
+at_resp *at_resp_ref(at_resp *r)
+{
+	__atomic_add_fetch(&r->refcnt, 1, __ATOMIC_RELAXED);
+	return r;
+}
+
+/*最后一个引用释放时归还所有分段*/
+void at_resp_unref(at_resp *r)
+{
+	at_seg *s, *next;
+	if (!r || __atomic_sub_fetch(&r->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	for (s = r->head; s; s = next) {
+		next = s->next;
+		free(s);
+		__atomic_sub_fetch(&mem_used, sizeof(at_seg), __ATOMIC_RELAXED);
+	}
+	free(r);
+}
+
+/*供发送队列回调使用*/
+void at_resp_release(void *r)
+{
+	at_resp_unref(r);
+}
+
+/*取得尾部可写空间，需要时追加新分段；超过内存上限返回 NULL*/
+char *at_resp_space(at_resp *r, int *size)
+{
+	at_seg *s = r->tail;
+	if (!s || s->len == AT_SEG_SIZE) {
+		if (__atomic_add_fetch(&mem_used, sizeof(at_seg), __ATOMIC_RELAXED) > mem_limit) {
+			__atomic_sub_fetch(&mem_used, sizeof(at_seg), __ATOMIC_RELAXED);
+			r->truncated = 1;
+			return NULL;
+		}
+		s = malloc(sizeof(at_seg));
+		if (!s) {
+			__atomic_sub_fetch(&mem_used, sizeof(at_seg), __ATOMIC_RELAXED);
+			r->truncated = 1;
+			return NULL;
+		}
+		s->next = NULL;
+		s->len = 0;
+		if (r->tail)
+			r->tail->next = s;
+		else
+			r->head = s;
+		r->tail = s;
+	}
+	*size = AT_SEG_SIZE - s->len;
+	return s->data + s->len;
+}
+
+/*确认写入了 n 字节*/
+void at_resp_commit(at_resp *r, int n)
+{
+	r->tail->len += n;
+	r->len += n;
+}
+
+/*拷贝成连续字符串（以 '\0' 结尾），返回拷贝的长度*/
+int at_resp_copy(const at_resp *r, char *dst, int size)
+{
+	const at_seg *s;
+	int n = 0, k;
+	for (s = r->head; s && n < size - 1; s = s->next) {
+		k = s->len < size - 1 - n ? s->len : size - 1 - n;
+		memcpy(dst + n, s->data, k);
+		n += k;
+	}
+	dst[n] = '\0';
+	return n;
+}
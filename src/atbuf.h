@@ -0,0 +1,39 @@
+#ifndef ATBUF_H
+#define ATBUF_H
+
+#define AT_SEG_SIZE (1024)				/* 单个分段大小 */
+#define AT_MEM_LIMIT (512 * 1024)		/* 默认所有应答缓冲区的内存上限 */
+
+/* 应答分段，串口数据直接读入分段，不再经过固定大小的缓冲区 */
+typedef struct _at_seg
+{
+	struct _at_seg *next;
+	int len;
+	char data[AT_SEG_SIZE];
+} at_seg;
+
+/* 引用计数的应答缓冲区，多个请求 / 缓存可共享同一份应答 */
+typedef struct _at_resp
+{
+	int refcnt;
+	int len;						/* 所有分段的总长度 */
+	int result;						/* AT_RESULT_xxx */
+	int truncated;					/* 超过内存上限，部分数据被丢弃 */
+	unsigned long long t_write;		/* 命令写完的时间（微秒） */
+	unsigned long long t_first;		/* 收到第一个字节的时间，0 表示没有应答 */
+	unsigned long long t_final;		/* 收到最终结果码或超时的时间 */
+	at_seg *head;
+	at_seg *tail;
+} at_resp;
+
+void at_mem_set_limit(long bytes);
+long at_mem_used(void);
+at_resp *at_resp_new(void);
+at_resp *at_resp_ref(at_resp *r);
+void at_resp_unref(at_resp *r);
+void at_resp_release(void *r);
+char *at_resp_space(at_resp *r, int *size);
+void at_resp_commit(at_resp *r, int n);
+int at_resp_copy(const at_resp *r, char *dst, int size);
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "atcmd.h"
+#include "serial.h"
+
+typedef struct _at_cmd_class
+{
+	const char *cmd;
+	int cls;
+} at_cmd_class;
+
+/* 只查询、不改变模块状态的命令（整条命令匹配，不区分大小写） */
+static const at_cmd_class query_cmds[] = {
+	/* 模块 / SIM 身份信息，运行期间不变 */
+	{ "ATI", AT_CLASS_IDENTITY }, { "AT+GSN", AT_CLASS_IDENTITY }, { "AT+CGSN", AT_CLASS_IDENTITY },
+	{ "AT+CIMI", AT_CLASS_IDENTITY }, { "AT+CCID", AT_CLASS_IDENTITY }, { "AT+ICCID", AT_CLASS_IDENTITY },
+	{ "AT+QCCID", AT_CLASS_IDENTITY }, { "AT+CGMI", AT_CLASS_IDENTITY }, { "AT+CGMM", AT_CLASS_IDENTITY },
+	{ "AT+CGMR", AT_CLASS_IDENTITY }, { "AT+GMI", AT_CLASS_IDENTITY }, { "AT+GMM", AT_CLASS_IDENTITY },
+	{ "AT+GMR", AT_CLASS_IDENTITY }, { "AT+CNUM", AT_CLASS_IDENTITY },
+	/* 信号、注册状态等，大约每秒变化 */
+	{ "AT+CSQ", AT_CLASS_RADIO }, { "AT+QCSQ", AT_CLASS_RADIO }, { "AT+QRSRP", AT_CLASS_RADIO },
+	{ "AT+QRSRQ", AT_CLASS_RADIO }, { "AT+QSINR", AT_CLASS_RADIO }, { "AT+QNWINFO", AT_CLASS_RADIO },
+	{ "AT+QSPN", AT_CLASS_RADIO }, { "AT+QCAINFO", AT_CLASS_RADIO }, { "AT+QTEMP", AT_CLASS_RADIO },
+	{ "AT+CREG?", AT_CLASS_RADIO }, { "AT+CGREG?", AT_CLASS_RADIO }, { "AT+CEREG?", AT_CLASS_RADIO },
+	{ "AT+C5GREG?", AT_CLASS_RADIO }, { "AT+COPS?", AT_CLASS_RADIO },
+	{ "AT+QENG=\"servingcell\"", AT_CLASS_RADIO }, { "AT+QENG=\"neighbourcell\"", AT_CLASS_RADIO },
+	/* 其他查询，不缓存 */
+	{ "AT+CPAS", AT_CLASS_QUERY }, { "AT+CEER", AT_CLASS_QUERY }, { "AT+CLCC", AT_CLASS_QUERY },
+	{ "AT+CBC", AT_CLASS_QUERY },
+	{ NULL, 0 }
+};
+
+/* 去掉末尾空白后的命令长度 */
+static int cmd_len(const char *at)
+{
+	int len = strlen(at);
+	while (len > 0 && (at[len - 1] == ' ' || at[len - 1] == '\r' || at[len - 1] == '\n'))
+		len--;
+	return len;
+}
+
+/*命令分类：身份信息、无线状态、其他查询，以及会改变模块状态的命令*/
+int at_class(const char *at)
+{
+	int i, len = cmd_len(at);
+
+	/* 用 ; 串联的多条命令（如 AT+CFUN=0;+CSQ?）按改变状态处理，只看结尾会误判为查询 */
+	if (memchr(at, ';', len))
+		return AT_CLASS_WRITE;
+	for (i = 0; query_cmds[i].cmd; i++) {
+		if ((int)strlen(query_cmds[i].cmd) == len && strncasecmp(at, query_cmds[i].cmd, len) == 0)
+			return query_cmds[i].cls;
+	}
+	/* ATI0 / ATI1 等 */
+	if (len == 4 && strncasecmp(at, "ATI", 3) == 0 && at[3] >= '0' && at[3] <= '9')
+		return AT_CLASS_IDENTITY;
+	/* 读命令 AT+X?、测试命令 AT+X=? */
+	if (len > 2 && at[len - 1] == '?')
+		return AT_CLASS_QUERY;
+	return AT_CLASS_WRITE;
+}
+
+/*判断命令是否只读：读命令 AT+X?、测试命令 AT+X=? 以及已知的查询类执行命令*/
+int at_is_readonly(const char *at)
+{
+	return at_class(at) != AT_CLASS_WRITE;
+}
+
+/*命令应答的缓存时间（毫秒），AT_TTL_FOREVER 表示一直有效，0 表示不缓存*/
+int at_cache_ttl(const char *at)
+{
+	switch (at_class(at)) {
+	case AT_CLASS_IDENTITY:
+		return AT_TTL_FOREVER;
+	case AT_CLASS_RADIO:
+		return AT_TTL_RADIO;
+	default:
+		return 0;
+	}
+}
+
+/*默认优先级：改变状态的命令多由操作员触发，优先于定时轮询*/
+int at_priority(const char *at)
+{
+	switch (at_class(at)) {
+	case AT_CLASS_WRITE:
+		return AT_PRIO_INTERACTIVE;
+	case AT_CLASS_IDENTITY:
+	case AT_CLASS_RADIO:
+		return AT_PRIO_BACKGROUND;
+	default:
+		return AT_PRIO_NORMAL;
+	}
+}
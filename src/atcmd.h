@@ -0,0 +1,18 @@
+#ifndef ATCMD_H
+#define ATCMD_H
+
+/* 命令分类 */
+#define AT_CLASS_WRITE (0)		/* 可能改变模块状态 */
+#define AT_CLASS_IDENTITY (1)	/* 身份信息：ATI、IMEI、IMSI、ICCID 等 */
+#define AT_CLASS_RADIO (2)		/* 无线状态：信号、注册、服务小区等 */
+#define AT_CLASS_QUERY (3)		/* 其他只读查询 */
+
+#define AT_TTL_FOREVER (-1)		/* 身份信息一直缓存，直到执行改变状态的命令 */
+#define AT_TTL_RADIO (1000)		/* 无线状态缓存时间（毫秒） */
+
+int at_class(const char *at);
+int at_is_readonly(const char *at);
+int at_cache_ttl(const char *at);
+int at_priority(const char *at);
+
+#endif
@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# 串口挂断测试：模拟模块在 AT+QSCAN（应答时间 180 秒）执行中关闭 AT 口，
+# 服务器应立即以 Code 502 应答，且串口线程不空转（期间服务器 CPU 时间远小于墙钟时间）。
+# 通过时输出一行 JSON 并以 0 退出，否则以非零状态退出。
+# 环境变量：BENCH_PORT 服务器端口（默认 18888）
+#
+cd "$(dirname "$0")/.." || exit 1
+
+PORT=${BENCH_PORT:-18888}
+LINK=/tmp/ttyHANGUP
+SCRIPT=/tmp/hangup_test.script
+
+stop() {
+	kill "$SRV" "$EMU" 2>/dev/null
+	wait 2>/dev/null
+	rm -f "$SCRIPT"
+}
+trap 'stop; exit 1' INT TERM
+
+cat > "$SCRIPT" <<'END'
+AT+CGSN         10      "$IMEI"
+AT+QSCAN*       200     result=hangup "+QSCAN: \"LTE\",460,01,1650,123,-95"
+*               10
+END
+
+./bench/modem_emu -n 1 -p 1 -l $LINK -s "$SCRIPT" > /dev/null &
+EMU=$!
+sleep 0.3
+./ATTool_APIServer -p "$PORT" -l warn -d ${LINK}0 > /tmp/attool_hangup.log 2>&1 &
+SRV=$!
+sleep 1
+if ! kill -0 "$SRV" 2>/dev/null; then
+	echo "server failed to start, see /tmp/attool_hangup.log" >&2
+	stop
+	exit 1
+fi
+
+# /proc/<pid>/stat 第 14、15 项为用户态、内核态时间（时钟滴答）
+cpu_ticks() {
+	awk '{ print $14 + $15 }' /proc/"$SRV"/stat
+}
+
+start=$(date +%s%N)
+cpu0=$(cpu_ticks)
+body=$(curl -s -m 20 "http://127.0.0.1:$PORT/AT+QSCAN")
+elapsed_ms=$((($(date +%s%N) - start) / 1000000))
+# 挂断之后的命令也应立即返回，而不是等到超时
+curl -s -m 20 "http://127.0.0.1:$PORT/AT+CSQ" > /dev/null
+sleep 1
+cpu_ms=$((($(cpu_ticks) - cpu0) * 1000 / $(getconf CLK_TCK)))
+wall_ms=$((($(date +%s%N) - start) / 1000000))
+stop
+
+code=$(printf '%s' "$body" | sed -n 's/.*"Code":[[:space:]]*"\([0-9]*\)".*/\1/p')
+printf '{"test": "hangup", "code": "%s", "response_ms": %d, "server_cpu_ms": %d, "wall_ms": %d}\n' \
+	"$code" "$elapsed_ms" "$cpu_ms" "$wall_ms"
+[ "$code" = 502 ] && [ "$elapsed_ms" -lt 2000 ] && [ "$cpu_ms" -lt $((wall_ms / 4)) ]
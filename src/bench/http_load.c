@@ -0,0 +1,411 @@
+/*
+ *  HTTP 压测客户端：单线程 epoll，同时保持 -c 个连接，每个连接收到完整应答后立即发下一个请求。
+ *  统计吞吐量和延迟分位数（从发出请求或短连接的 connect 开始，到收完应答为止），
+ *  -P 指定服务器进程时附带其 RSS；结果以一行 JSON 输出，便于版本间对比。
+ *  -i 另外打开的空闲长连接：每个连接只发一个请求，收到应答后保持连接不再发送，
+ *  结束时统计仍被服务器保持的个数；这些连接不计入吞吐量和延迟。
+ *
+ *  用法：http_load [-h 地址] [-p 端口] [-c 连接数] [-i 空闲连接数] [-d 秒] [-k|-K] [-n 名称] [-P 服务器pid] 路径[:权重] ...
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define MAX_PATHS (32)
+#define MAX_CONNS (4096)
+#define MAX_IDLE (60000)
+#define REQ_SIZE (1024)
+#define RESP_SIZE (256 * 1024)		/* 应答最大长度，超出按错误处理 */
+#define IDLE_RESP_SIZE (4096)		/* 空闲连接只收第一个应答 */
+
+#define CONN_ACTIVE (0)
+#define CONN_IDLE_FIRST (1)			/* 空闲连接：等待第一个请求的应答 */
+#define CONN_IDLE_HELD (2)			/* 空闲连接：已收到应答，保持不动 */
+
+typedef struct _load_path
+{
+	char req[REQ_SIZE];			/* 完整的请求报文 */
+	int len;
+	int weight;
+} load_path;
+
+typedef struct _load_conn
+{
+	int fd;
+	int sent;					/* 请求已发出的字节数 */
+	load_path *path;
+	unsigned long long start;	/* 请求开始时间（微秒） */
+	char *buf;
+	int len;
+	int cap;						/* buf 容量 */
+	int state;						/* CONN_ACTIVE / CONN_IDLE_* */
+} load_conn;
+
+static load_path paths[MAX_PATHS];
+static int npaths, total_weight;
+static struct sockaddr_in addr;
+static int epfd;
+static int keepalive = 1;
+static unsigned int seed = 1;
+
+static unsigned long long *samples;	/* 每个请求的延迟（微秒） */
+static long nsamples, cap_samples;
+static unsigned long status_2xx, status_4xx, status_5xx, errors, connects;
+static unsigned long idle_held, idle_dropped;
+
+static unsigned long long now_usec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void add_path(const char *host, const char *spec)
+{
+	load_path *p = &paths[npaths];
+	const char *colon = strrchr(spec, ':');
+	int plen = strlen(spec);
+
+	if (npaths >= MAX_PATHS)
+		return;
+	p->weight = 1;
+	if (colon && colon[1] >= '0' && colon[1] <= '9') {
+		p->weight = atoi(colon + 1) > 0 ? atoi(colon + 1) : 1;
+		plen = colon - spec;
+	}
+	p->len = snprintf(p->req, sizeof(p->req), "GET %.*s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n\r\n",
+		plen, spec, host, keepalive ? "keep-alive" : "close");
+	total_weight += p->weight;
+	npaths++;
+}
+
+static load_path *pick_path(void)
+{
+	int w = rand_r(&seed) % total_weight;
+	for (int i = 0; i < npaths; i++) {
+		if ((w -= paths[i].weight) < 0)
+			return &paths[i];
+	}
+	return &paths[0];
+}
+
+static void record(unsigned long long usec)
+{
+	if (nsamples == cap_samples) {
+		cap_samples = cap_samples ? cap_samples * 2 : 65536;
+		samples = realloc(samples, cap_samples * sizeof(samples[0]));
+	}
+	samples[nsamples++] = usec;
+}
+
+static int conn_open(load_conn *c)
+{
+	struct epoll_event ev;
+	int one = 1;
+
+	c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (c->fd < 0)
+		return -1;
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	connects++;
+	if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+		close(c->fd);
+		return -1;
+	}
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.ptr = c;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void conn_close(load_conn *c)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+}
+
+/*开始下一个请求，短连接先重新建立连接*/
+static void next_request(load_conn *c, int reconnect)
+{
+	struct epoll_event ev;
+
+	c->path = pick_path();
+	c->sent = 0;
+	c->len = 0;
+	c->start = now_usec();
+	if (reconnect || c->fd < 0) {
+		if (c->fd >= 0)
+			conn_close(c);
+		if (conn_open(c) < 0) {
+			errors++;
+			c->fd = -1;
+		}
+		return;
+	}
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.ptr = c;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void do_send(load_conn *c)
+{
+	struct epoll_event ev;
+	int n;
+
+	while (c->sent < c->path->len) {
+		n = send(c->fd, c->path->req + c->sent, c->path->len - c->sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EAGAIN)
+			return;
+		if (n <= 0) {
+			errors++;
+			next_request(c, 1);
+			return;
+		}
+		c->sent += n;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = c;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/*应答完整时返回总长度，否则返回 0；*close 表示服务器要求关闭连接*/
+static int response_complete(load_conn *c, int *status, int *close_conn)
+{
+	char *end, *cl, *conn;
+	int head, body;
+
+	c->buf[c->len] = '\0';
+	if (!(end = strstr(c->buf, "\r\n\r\n")))
+		return 0;
+	head = end + 4 - c->buf;
+	*status = atoi(c->buf + 9);
+	cl = strcasestr(c->buf, "\r\nContent-Length:");
+	body = cl && cl < end ? atoi(cl + 17) : 0;
+	conn = strcasestr(c->buf, "\r\nConnection: close");
+	*close_conn = conn && conn < end;
+	return c->len >= head + body ? head + body : 0;
+}
+
+/*空闲连接收到第一个应答后只关注对端关闭*/
+static void idle_hold(load_conn *c, int close_conn)
+{
+	struct epoll_event ev;
+
+	if (close_conn) {
+		idle_dropped++;
+		conn_close(c);
+		return;
+	}
+	c->state = CONN_IDLE_HELD;
+	idle_held++;
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = c;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/*保持中的空闲连接有事件只可能是服务器关闭了连接*/
+static void idle_event(load_conn *c)
+{
+	char buf[256];
+
+	if (recv(c->fd, buf, sizeof(buf), 0) < 0 && errno == EAGAIN)
+		return;
+	idle_held--;
+	idle_dropped++;
+	conn_close(c);
+}
+
+static void do_recv(load_conn *c)
+{
+	int n, status, close_conn, total;
+
+	for (;;) {
+		if (c->len >= c->cap - 1) {
+			errors++;
+			next_request(c, 1);
+			return;
+		}
+		n = recv(c->fd, c->buf + c->len, c->cap - 1 - c->len, 0);
+		if (n < 0 && errno == EAGAIN)
+			return;
+		if (n <= 0) {
+			/* 服务器在应答前关闭了连接 */
+			errors++;
+			next_request(c, 1);
+			return;
+		}
+		c->len += n;
+		if ((total = response_complete(c, &status, &close_conn)) > 0)
+			break;
+	}
+	if (c->state == CONN_IDLE_FIRST) {
+		idle_hold(c, close_conn);
+		return;
+	}
+	record(now_usec() - c->start);
+	if (status >= 200 && status < 300)
+		status_2xx++;
+	else if (status >= 400 && status < 500)
+		status_4xx++;
+	else
+		status_5xx++;
+	next_request(c, !keepalive || close_conn);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*从 /proc/<pid>/status 读取 VmRSS / VmHWM（KB）*/
+static long proc_kb(int pid, const char *key)
+{
+	char path[64], line[256];
+	long kb = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	if (!(f = fopen(path, "r")))
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, key, strlen(key)) == 0) {
+			kb = atol(line + strlen(key) + 1);
+			break;
+		}
+	}
+	fclose(f);
+	return kb;
+}
+
+static unsigned long long pct(double p)
+{
+	long i = (long)(nsamples * p);
+	if (i >= nsamples)
+		i = nsamples - 1;
+	return nsamples ? samples[i] : 0;
+}
+
+static void dispatch(load_conn *c, unsigned int events)
+{
+	if (c->fd < 0)
+		return;
+	if (c->state == CONN_IDLE_HELD) {
+		idle_event(c);
+		return;
+	}
+	if (events & (EPOLLERR | EPOLLHUP) && !(events & EPOLLIN)) {
+		errors++;
+		next_request(c, 1);
+		return;
+	}
+	if (events & EPOLLOUT)
+		do_send(c);
+	else if (events & EPOLLIN)
+		do_recv(c);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: http_load [options] path[:weight] ...\n"
+		"\t-h <server address> (default: 127.0.0.1)\n"
+		"\t-p <server port> (default: 8888)\n"
+		"\t-c <connections> (default: 16)\n"
+		"\t-i <idle keep-alive connections held alongside> (default: 0)\n"
+		"\t-d <duration in seconds> (default: 5)\n"
+		"\t-k keep-alive (default) / -K close the connection after each request\n"
+		"\t-n <workload name>\n"
+		"\t-P <server pid> report its RSS\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *host = "127.0.0.1", *name = "load";
+	int port = 8888, nconns = 16, nidle = 0, duration = 5, pid = 0, ch;
+	struct epoll_event events[256];
+	unsigned long long start, deadline, elapsed;
+	load_conn *conns, *idle;
+
+	while ((ch = getopt(argc, argv, "h:p:c:i:d:kKn:P:")) != -1) {
+		switch (ch) {
+		case 'h': host = optarg; break;
+		case 'p': port = atoi(optarg); break;
+		case 'c': nconns = atoi(optarg); break;
+		case 'i': nidle = atoi(optarg); break;
+		case 'd': duration = atoi(optarg); break;
+		case 'k': keepalive = 1; break;
+		case 'K': keepalive = 0; break;
+		case 'n': name = optarg; break;
+		case 'P': pid = atoi(optarg); break;
+		default: usage();
+		}
+	}
+	if (optind >= argc || nconns < 1 || nconns > MAX_CONNS || nidle < 0 || nidle > MAX_IDLE || duration < 1)
+		usage();
+	for (int i = optind; i < argc; i++)
+		add_path(host, argv[i]);
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr(host);
+	epfd = epoll_create1(0);
+	/* 空闲连接先建立，活动连接的延迟在其全部保持之后开始统计 */
+	idle = calloc(nidle ? nidle : 1, sizeof(load_conn));
+	for (int i = 0; i < nidle; i++) {
+		idle[i].fd = -1;
+		idle[i].cap = IDLE_RESP_SIZE;
+		idle[i].buf = malloc(IDLE_RESP_SIZE);
+		idle[i].state = CONN_IDLE_FIRST;
+		next_request(&idle[i], 1);
+	}
+	for (deadline = now_usec() + 10000000; idle_held + idle_dropped < (unsigned long)nidle && now_usec() < deadline; ) {
+		int n = epoll_wait(epfd, events, 256, 100);
+		for (int i = 0; i < n; i++)
+			dispatch(events[i].data.ptr, events[i].events);
+	}
+	conns = calloc(nconns, sizeof(load_conn));
+	for (int i = 0; i < nconns; i++) {
+		conns[i].fd = -1;
+		conns[i].cap = RESP_SIZE;
+		conns[i].buf = malloc(RESP_SIZE);
+		next_request(&conns[i], 1);
+	}
+
+	start = now_usec();
+	deadline = start + (unsigned long long)duration * 1000000;
+	while (now_usec() < deadline) {
+		int n = epoll_wait(epfd, events, 256, 100);
+		for (int i = 0; i < n; i++)
+			dispatch(events[i].data.ptr, events[i].events);
+	}
+	elapsed = now_usec() - start;
+
+	qsort(samples, nsamples, sizeof(samples[0]), cmp_ull);
+	printf("{\"workload\": \"%s\", \"connections\": %d, \"keepalive\": %s, \"duration_s\": %.2f, "
+		"\"requests\": %ld, \"rps\": %.1f, \"errors\": %lu, \"connects\": %lu, "
+		"\"status\": {\"2xx\": %lu, \"4xx\": %lu, \"5xx\": %lu}, "
+		"\"latency_us\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+		name, nconns, keepalive ? "true" : "false", elapsed / 1e6,
+		nsamples, nsamples / (elapsed / 1e6), errors, connects,
+		status_2xx, status_4xx, status_5xx,
+		pct(0.5), pct(0.9), pct(0.99), pct(0.999), nsamples ? samples[nsamples - 1] : 0);
+	if (nidle)
+		printf(", \"idle\": {\"opened\": %d, \"held\": %lu, \"dropped\": %lu}", nidle, idle_held, idle_dropped);
+	if (pid > 0)
+		printf(", \"rss_kb\": %ld, \"rss_peak_kb\": %ld", proc_kb(pid, "VmRSS:"), proc_kb(pid, "VmHWM:"));
+	printf("}\n");
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ *  HTTP 请求解析微基准：把 bench/http_requests.txt 中的请求逐个交给旧的 strtok/sscanf 解析
+ *  （改动前 handle() 中的写法，原样保留在下面）和 http_parse，两者都包含请求目标的 % 解码。
+ *  split 为 http_parse 分两次 recv 收到请求的情况（在请求中间断开后继续解析）。
+ *  每项结果输出一行 JSON，ns_per_op 为每个请求的耗时；同时核对两者解码出的请求目标是否相同。
+ *
+ *  用法：http_parse [请求文件] [轮数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "../http.h"
+#include "../tool.h"
+
+#define MAX_REQUESTS (256)
+#define BUFFER_SIZE (8192)		/* 与改动前 handle() 的接收缓冲区相同 */
+
+typedef struct _capture
+{
+	char *text;
+	int len;
+} capture;
+
+static capture reqs[MAX_REQUESTS];
+static int nreqs;
+static volatile int sink;		/* 防止解析结果被优化掉 */
+
+static void report(const char *shape, int n, long ops, unsigned long long nsec)
+{
+	printf("{\"bench\": \"http_parse\", \"shape\": \"%s\", \"n\": %d, \"ops\": %ld, \"total_ms\": %.3f, \"ns_per_op\": %.1f}\n",
+		shape, n, ops, nsec / 1e6, (double)nsec / ops);
+}
+
+/*读取请求文件，# 开头的行是注释，行尾换成 \r\n*/
+static int load(const char *file)
+{
+	FILE *f = fopen(file, "r");
+	char line[1024], buf[BUFFER_SIZE];
+	int len = 0, n;
+
+	if (!f)
+		return -1;
+	for (;;) {
+		char *l = fgets(line, sizeof(line), f);
+		if (!l || strncmp(line, "====", 4) == 0) {
+			if (len > 2 && nreqs < MAX_REQUESTS) {
+				if (len < 4 || memcmp(buf + len - 4, "\r\n\r\n", 4))
+					len -= 2;	/* 请求体后面的换行不属于请求 */
+				reqs[nreqs].text = malloc(len + 1);
+				memcpy(reqs[nreqs].text, buf, len);
+				reqs[nreqs].text[len] = '\0';
+				reqs[nreqs++].len = len;
+			}
+			len = 0;
+			if (!l)
+				break;
+			continue;
+		}
+		if (line[0] == '#')
+			continue;
+		n = strcspn(line, "\r\n");
+		if (len + n + 2 > BUFFER_SIZE)
+			continue;
+		memcpy(buf + len, line, n);
+		memcpy(buf + len + n, "\r\n", 2);
+		len += n + 2;
+	}
+	fclose(f);
+	return nreqs;
+}
+
+/*改动前的解析：拷贝到接收缓冲区后按行 strtok，请求行和 Host 行用 sscanf*/
+static void old_parse(const capture *c, char *enstr)
+{
+	char buffer[BUFFER_SIZE];
+	char method[10];
+	char path[100];
+	char protocol[10];
+	char hostname[100];
+	char useragent[100];
+	char acceptheader[100];
+	int lineCount = 0;
+
+	bzero(buffer, BUFFER_SIZE);
+	memcpy(buffer, c->text, c->len);
+	for(const char *line = strtok((char*)buffer, "\r\n"); line != NULL; line = strtok(NULL, "\r\n")){
+		if(strlen(line)>0){
+			switch(lineCount++){
+				case 0: sscanf(line,"%s %[^ ]",method,path); break;
+				case 1: sscanf(line,"%s:%s",hostname,protocol); break;
+				case 2: snprintf(useragent,sizeof(useragent),"%s",line); break;
+				case 3: snprintf(acceptheader,sizeof(acceptheader),"%s",line); break;
+			}
+		}
+	}
+	decode_str(enstr, path);
+	sink += method[0] + hostname[0] + useragent[0] + acceptheader[0];
+}
+
+/*新的解析：在接收缓冲区上原地解析，split 为 0 时一次收齐，否则先解析前 split 字节*/
+static void new_parse(const capture *c, char *enstr, int split)
+{
+	char rbuf[BUFFER_SIZE + 1];
+	http_request req;
+	int ret;
+
+	memcpy(rbuf, c->text, c->len);
+	http_reset(&req);
+	if (split && http_parse(&req, rbuf, split) != HTTP_AGAIN)
+		return;
+	ret = http_parse(&req, rbuf, c->len);
+	if (ret <= 0)
+		return;
+	decode_strn(enstr, 1024, req.target.p, req.target.len);
+	sink += req.method.len + req.nheaders + req.keepalive;
+}
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = argc > 1 ? argv[1] : "bench/http_requests.txt";
+	long rounds = argc > 2 ? atol(argv[2]) : 200000;
+	char old_target[1024], new_target[1024];
+	unsigned long long start;
+	int bad = 0;
+
+	if (load(file) <= 0) {
+		fprintf(stderr, "http_parse: no requests in %s\n", file);
+		return 2;
+	}
+	for (int i = 0; i < nreqs; i++) {
+		old_target[0] = new_target[0] = '\0';
+		old_parse(&reqs[i], old_target);
+		new_parse(&reqs[i], new_target, 0);
+		if (strcmp(old_target, new_target)) {
+			fprintf(stderr, "http_parse: request %d: old \"%s\" new \"%s\"\n", i, old_target, new_target);
+			bad++;
+		}
+	}
+
+	start = now_nsec();
+	for (long r = 0; r < rounds; r++)
+		for (int i = 0; i < nreqs; i++)
+			old_parse(&reqs[i], old_target);
+	report("old", nreqs, rounds * nreqs, now_nsec() - start);
+
+	start = now_nsec();
+	for (long r = 0; r < rounds; r++)
+		for (int i = 0; i < nreqs; i++)
+			new_parse(&reqs[i], new_target, 0);
+	report("new", nreqs, rounds * nreqs, now_nsec() - start);
+
+	start = now_nsec();
+	for (long r = 0; r < rounds; r++)
+		for (int i = 0; i < nreqs; i++)
+			new_parse(&reqs[i], new_target, reqs[i].len / 2);
+	report("split", nreqs, rounds * nreqs, now_nsec() - start);
+	return bad ? 1 : 0;
+}
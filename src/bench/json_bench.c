@@ -0,0 +1,513 @@
+/*
+ *  JSON 库的微基准，每项结果输出一行 JSON，便于版本间对比。
+ *
+ *  array：用 json_add_*_to_array / json_add_*_to_object 逐个追加 N 个元素，
+ *         统计总耗时和平均每次追加的耗时，追加为常数时间时后者不随 N 增长。
+ *  lookup：在有 N 个键的对象中用 json_get_child 随机查找已有的键（大小写与存入时不同），
+ *         以及用 json_get_by_keys 查找三层嵌套对象中的键，统计每次查找的耗时。
+ *  writer：生成与 AT 应答相同形状的文档（Result 为 N 字节的模块应答），
+ *         比较建树后 json_dumps 再拷贝进发送缓冲区，与 json_writer 直接写入发送缓冲区的每份耗时。
+ *  pull：N 条 AT 命令的批量请求体，比较收齐后 json_loads 建树，与按 recv 分块交给 json_pull 逐个取出命令的每份耗时，
+ *         后者只用 256 字节的缓冲区。
+ *  threads：N 个线程各用自己的 json_context 反复解析、序列化同一份批量命令请求体，并穿插解析出错的文本
+ *         核对各自的错误位置，ns_per_op 为总耗时除以所有线程的文档数，随线程数线性扩展时按 1/N 下降。
+ *  string：N 字节的模块应答文本（每行 64 字节，以 \r\n 结束）作为字符串值，分别用 json_dumps 转义、
+ *         json_loads 和 json_pull 解析，ops 为处理的字节数，ns_per_op 即每字节的耗时。
+ *  number：N 条历史记录（时间戳、RSSI、RSRP、SINR、计数）组成的数组，分别用 json_dumps 输出、json_loads 解析，
+ *         ops 为数字个数，ns_per_op 即每个数字的耗时；另外核对随机 double 输出后再解析是否逐位相同。
+ *
+ *  用法：json_bench array|lookup|writer|pull|threads|string|number [元素个数 ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../json.h"
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*ops 次操作共耗时 nsec*/
+static void report(const char *bench, const char *shape, int n, long ops, unsigned long long nsec)
+{
+	printf("{\"bench\": \"%s\", \"shape\": \"%s\", \"n\": %d, \"ops\": %ld, \"total_ms\": %.3f, \"ns_per_op\": %.1f}\n",
+		bench, shape, n, ops, nsec / 1e6, (double)nsec / ops);
+}
+
+/*数组：整数元素和对象元素（短信列表、扫网结果的形状）*/
+static void bench_array(int n)
+{
+	unsigned long long start;
+	json_t a;
+	char buf[16], *key = buf;
+
+	a = json_create_array(NULL);
+	start = now_nsec();
+	for (int i = 0; i < n; i++)
+		json_add_int_to_array(a, i);
+	report("array", "int", n, n, now_nsec() - start);
+	if (json_get_size(a) != n)
+		fprintf(stderr, "array size %d != %d\n", json_get_size(a), n);
+	json_delete(a);
+
+	a = json_create_array(NULL);
+	start = now_nsec();
+	for (int i = 0; i < n; i++) {
+		json_t o = json_add_object_to_array(a);
+		json_add_int_to_object(o, "Index", i);
+		json_add_string_to_object(o, "Status", "REC READ");
+	}
+	report("array", "object", n, n, now_nsec() - start);
+	json_delete(a);
+
+	a = json_create_object(NULL);
+	start = now_nsec();
+	for (int i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "k%d", i);
+		json_add_int_to_object(a, key, i);
+	}
+	report("array", "object_keys", n, n, now_nsec() - start);
+	json_delete(a);
+}
+
+#define LOOKUPS (1000000)
+
+/*添加 field_0 .. field_<n-1> 共 n 个键*/
+static void fill_object(json_t o, int n)
+{
+	char buf[32], *key = buf;
+	for (int i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "field_%d", i);
+		json_add_int_to_object(o, key, i);
+	}
+}
+
+static void bench_lookup(int n)
+{
+	unsigned long long start;
+	unsigned int seed = 1;
+	json_t root, level;
+	char (*keys)[32];
+	long found = 0;
+
+	/* 三层对象，每层 n 个键，前两层另有一个 nested 子对象 */
+	root = json_create_object(NULL);
+	fill_object(root, n);
+	level = json_add_object_to_object(root, "nested");
+	fill_object(level, n);
+	fill_object(json_add_object_to_object(level, "nested"), n);
+
+	keys = malloc(sizeof(*keys) * LOOKUPS);
+	for (int i = 0; i < LOOKUPS; i++)
+		snprintf(keys[i], sizeof(keys[i]), "FIELD_%d", rand_r(&seed) % n);
+
+	start = now_nsec();
+	for (int i = 0; i < LOOKUPS; i++)
+		found += json_get_child(root, keys[i], 0) != NULL;
+	report("lookup", "get_child", n, LOOKUPS, now_nsec() - start);
+
+	start = now_nsec();
+	for (int i = 0; i < LOOKUPS; i++)
+		found += json_get_by_keys(root, "NESTED", "NESTED", keys[i], NULL) != NULL;
+	report("lookup", "get_by_keys", n, LOOKUPS, now_nsec() - start);
+
+	if (found != 2L * LOOKUPS)
+		fprintf(stderr, "lookup found %ld of %d\n", found, 2 * LOOKUPS);
+	free(keys);
+	json_delete(root);
+}
+
+#define DOCS (20000)
+#define SINK_SIZE (16 * 1024)
+
+/*模拟连接的发送队列：固定大小的窗口，写满后丢弃（相当于交给 sendmsg）*/
+static char sink[SINK_SIZE];
+static long sink_bytes;
+
+static int sink_flush(json_buffer *buf, int needed)
+{
+	sink_bytes += buf->end;
+	buf->end = 0;
+	buf->address = sink;
+	buf->size = SINK_SIZE;
+	return needed <= SINK_SIZE;
+}
+
+/*与 respond_resp 相同的字段，应答分成多段时逐段写入*/
+static void doc_writer(const char *result, int n)
+{
+	json_writer w;
+
+	json_writer_init(&w, 1, sink_flush, NULL);
+	json_write_begin_object(&w, NULL);
+	json_write_int(&w, "time", 1700000000);
+	json_write_string(&w, "Code", "200");
+	json_write_string(&w, "AT", "AT+QLTS?");
+	json_write_string_begin(&w, "Result");
+	for (int off = 0; off < n; off += 4096)
+		json_write_string_append(&w, result + off, n - off < 4096 ? n - off : 4096);
+	json_write_string_end(&w);
+	json_write_begin_object(&w, "timing");
+	json_write_int(&w, "parsed", 5);
+	json_write_int(&w, "respond", 20000);
+	json_write_end_object(&w);
+	json_write_end_object(&w);
+	if (!json_write_finish(&w))
+		fprintf(stderr, "writer failed\n");
+}
+
+/*改动前的做法：应答先拼成一个字符串，建树，json_dumps，再拷贝进发送缓冲区*/
+static void doc_tree(const char *result, int n)
+{
+	json_t json, t;
+	char *copy, *out;
+	int len;
+
+	copy = malloc(n + 1);
+	memcpy(copy, result, n);
+	copy[n] = '\0';
+	json = json_create_object(NULL);
+	json_add_int_to_object(json, "time", 1700000000);
+	json_add_string_to_object(json, "Code", "200");
+	json_add_string_to_object(json, "AT", "AT+QLTS?");
+	json_add_string_to_object(json, "Result", copy);
+	t = json_add_object_to_object(json, "timing");
+	json_add_int_to_object(t, "parsed", 5);
+	json_add_int_to_object(t, "respond", 20000);
+	out = json_dumps(json, 0, 0, &len);
+	for (int off = 0; off < len; off += SINK_SIZE)
+		memcpy(sink, out + off, len - off < SINK_SIZE ? len - off : SINK_SIZE);
+	sink_bytes += len;
+	free(out);
+	json_delete(json);
+	free(copy);
+}
+
+static void bench_writer(int n)
+{
+	unsigned long long start;
+	char *result = malloc(n);
+	long bytes;
+
+	/* 模块应答：可打印字符，每行以 \r\n 结束 */
+	for (int i = 0; i < n; i++)
+		result[i] = i % 64 == 62 ? '\r' : i % 64 == 63 ? '\n' : 'A' + i % 26;
+
+	sink_bytes = 0;
+	start = now_nsec();
+	for (int i = 0; i < DOCS; i++)
+		doc_tree(result, n);
+	report("writer", "tree", n, DOCS, now_nsec() - start);
+	bytes = sink_bytes;
+
+	sink_bytes = 0;
+	start = now_nsec();
+	for (int i = 0; i < DOCS; i++)
+		doc_writer(result, n);
+	report("writer", "stream", n, DOCS, now_nsec() - start);
+	if (sink_bytes != bytes)
+		fprintf(stderr, "writer wrote %ld bytes, tree %ld\n", sink_bytes, bytes);
+	free(result);
+}
+
+#define PULL_CHUNK (1460)				/* 一个 TCP 报文段 */
+
+/*收齐后建树，再取出每条命令*/
+static long doc_loads(const char *text)
+{
+	json_t json = json_loads(text), item;
+	long found = 0;
+
+	json_array_for_each(json_get_child(json, "Commands", 0), item) {
+		found += json_value_string(json_get_child(item, "AT", 0)) != NULL;
+	}
+	json_delete(json);
+	return found;
+}
+
+/*按报文段分块输入，遇到 AT 键时取其后的字符串*/
+static long doc_pull(const char *text, int len)
+{
+	char buf[256];
+	json_pull p;
+	long found = 0;
+	int off = 0, ev, at = 0;
+
+	json_pull_init(&p, buf, sizeof(buf));
+	while ((ev = json_pull_next(&p)) != JSON_PULL_END) {
+		if (ev == JSON_PULL_MORE) {
+			int n = len - off < PULL_CHUNK ? len - off : PULL_CHUNK;
+			json_pull_feed(&p, text + off, n);
+			off += n;
+		}
+		else if (ev == JSON_PULL_ERROR)
+			return -1;
+		else if (ev == JSON_PULL_KEY)
+			at = strcmp(p.token, "AT") == 0;
+		else if (ev == JSON_PULL_STRING && at)
+			found++;
+	}
+	return found;
+}
+
+static void bench_pull(int n)
+{
+	unsigned long long start;
+	json_t json = json_create_object(NULL), cmds, c;
+	char at[32], *text;
+	int docs = 20000000 / (n * 64 + 64), len;
+	long found = 0;
+
+	json_add_int_to_object(json, "Modem", 0);
+	cmds = json_add_array_to_object(json, "Commands");
+	for (int i = 0; i < n; i++) {
+		c = json_add_object_to_array(cmds);
+		snprintf(at, sizeof(at), "AT+CMGR=%d", i);
+		json_add_string_to_object(c, "AT", at);
+		json_add_string_to_object(c, "Priority", "background");
+		json_add_int_to_object(c, "Timeout", 300);
+	}
+	text = json_dumps(json, 0, 0, &len);
+	json_delete(json);
+
+	start = now_nsec();
+	for (int i = 0; i < docs; i++)
+		found += doc_loads(text);
+	report("pull", "loads", n, docs, now_nsec() - start);
+
+	start = now_nsec();
+	for (int i = 0; i < docs; i++)
+		found -= doc_pull(text, len);
+	report("pull", "pull", n, docs, now_nsec() - start);
+	if (found != 0)
+		fprintf(stderr, "pull found %ld fewer commands than loads\n", found);
+	free(text);
+}
+
+#define THREAD_DOCS (5000)			/* 每个线程解析的文档数 */
+
+static char *thread_text;
+
+/*第 3 行第 11 列缺少冒号*/
+static const char bad_text[] = "{\n\"Commands\": [\n    {\"AT\" \"ATI\"}]}";
+
+static void *parse_thread(void *arg)
+{
+	json_context ctx;
+	long *errors = arg;
+	int line, column;
+
+	json_context_init(&ctx, NULL, NULL, NULL);
+	for (int i = 0; i < THREAD_DOCS; i++) {
+		json_t json = json_context_loads(&ctx, thread_text, 1, NULL);
+		char *out = json_context_dumps(&ctx, json, 0, 1, NULL);
+		if (!json || !out)
+			(*errors)++;
+		ctx.free_(out);
+		json_context_delete(&ctx, json);
+		if (i % 16 == 0 && (json_context_loads(&ctx, bad_text, 1, NULL)
+			|| json_context_error_info(&ctx, &line, &column) != JSON_E_INDICATOR || line != 3 || column != 11))
+			(*errors)++;
+	}
+	return NULL;
+}
+
+static void bench_threads(int n)
+{
+	unsigned long long start;
+	json_t json = json_create_object(NULL), cmds, c;
+	pthread_t tid[64];
+	long errors[64] = { 0 }, total = 0;
+	char at[32];
+
+	if (n > 64)
+		n = 64;
+	cmds = json_add_array_to_object(json, "Commands");
+	for (int i = 0; i < 64; i++) {
+		c = json_add_object_to_array(cmds);
+		snprintf(at, sizeof(at), "AT+CMGR=%d", i);
+		json_add_string_to_object(c, "AT", at);
+		json_add_string_to_object(c, "Priority", "background");
+		json_add_int_to_object(c, "Timeout", 300);
+	}
+	thread_text = json_dumps(json, 0, 0, NULL);
+	json_delete(json);
+
+	start = now_nsec();
+	for (int i = 0; i < n; i++)
+		pthread_create(&tid[i], NULL, parse_thread, &errors[i]);
+	for (int i = 0; i < n; i++) {
+		pthread_join(tid[i], NULL);
+		total += errors[i];
+	}
+	report("threads", "loads_dumps", n, (long)n * THREAD_DOCS, now_nsec() - start);
+	if (total)
+		fprintf(stderr, "threads: %ld wrong results\n", total);
+	free(thread_text);
+}
+
+#define STRING_BYTES (64L << 20)		/* 每项处理的总字节数 */
+
+static void bench_string(int n)
+{
+	unsigned long long start;
+	char *text = malloc(n + 1), *out, buf[4096];
+	long reps = STRING_BYTES / n, ok = 0;
+	json_t json;
+	json_pull p;
+	int len, ev;
+
+	for (int i = 0; i < n; i++)
+		text[i] = i % 64 == 62 ? '\r' : i % 64 == 63 ? '\n' : 'A' + i % 26;
+	text[n] = '\0';
+	json = json_create_string(NULL, text);
+
+	start = now_nsec();
+	for (long i = 0; i < reps; i++) {
+		out = json_dumps(json, n + n / 16 + 8, 1, &len);
+		free(out);
+	}
+	report("string", "dumps", n, reps * n, now_nsec() - start);
+	json_delete(json);
+
+	out = json_dumps(json = json_create_string(NULL, text), 0, 1, &len);
+	json_delete(json);
+	start = now_nsec();
+	for (long i = 0; i < reps; i++) {
+		json = json_loads(out);
+		ok += json_value_string(json) != NULL;
+		json_delete(json);
+	}
+	report("string", "loads", n, reps * n, now_nsec() - start);
+
+	start = now_nsec();
+	for (long i = 0; i < reps; i++) {
+		int off = 0;
+		json_pull_init(&p, buf, sizeof(buf));
+		while ((ev = json_pull_next(&p)) != JSON_PULL_END && ev != JSON_PULL_ERROR) {
+			if (ev == JSON_PULL_MORE) {
+				int k = len - off < PULL_CHUNK ? len - off : PULL_CHUNK;
+				json_pull_feed(&p, out + off, k);
+				off += k;
+			}
+		}
+		ok += ev == JSON_PULL_END;
+	}
+	report("string", "pull", n, reps * n, now_nsec() - start);
+	if (ok != 2 * reps)
+		fprintf(stderr, "string: %ld of %ld parsed\n", ok, 2 * reps);
+	free(out);
+	free(text);
+}
+
+#define NUMBER_VALUES (4L << 20)		/* 每项处理的数字个数 */
+
+static void bench_number(int n)
+{
+	unsigned long long start, bits, seed = 88172645463325252ULL;
+	long reps = NUMBER_VALUES / (n * 5L) + 1, ok = 0, bad = 0;
+	json_t json = json_create_array(NULL), rec, back;
+	char *out;
+	int len;
+	double v, w;
+
+	for (int i = 0; i < n; i++) {
+		rec = json_create_array(NULL);
+		json_add_int_to_array(rec, 1700000000 + i * 60);
+		json_add_int_to_array(rec, -60 - i % 50);
+		json_add_float_to_array(rec, (-362 - i % 40) / 4.0);
+		json_add_float_to_array(rec, (123 + i % 100) / 10.0);
+		json_add_int_to_array(rec, i * 1237);
+		json_attach(json, JSON_TAIL, rec);
+	}
+
+	start = now_nsec();
+	for (long i = 0; i < reps; i++) {
+		out = json_dumps(json, n * 48, 1, &len);
+		free(out);
+	}
+	report("number", "dumps", n, reps * n * 5, now_nsec() - start);
+
+	out = json_dumps(json, 0, 1, &len);
+	start = now_nsec();
+	for (long i = 0; i < reps; i++) {
+		back = json_loads(out);
+		ok += json_get_size(back) == n;
+		json_delete(back);
+	}
+	report("number", "loads", n, reps * n * 5, now_nsec() - start);
+	if (ok != reps)
+		fprintf(stderr, "number: %ld of %ld parsed\n", ok, reps);
+	free(out);
+	json_delete(json);
+
+	/* 随机位模式的 double 输出后再解析，应逐位相同 */
+	for (int i = 0; i < n; i++) {
+		seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+		bits = seed;
+		memcpy(&v, &bits, sizeof(v));
+		if (v != v || v - v != 0)
+			continue;
+		json = json_create_float(NULL, v);
+		out = json_dumps(json, 0, 1, &len);
+		back = json_loads(out);
+		w = json_value_float(back);
+		bad += memcmp(&v, &w, sizeof(v)) != 0;
+		json_delete(back);
+		json_delete(json);
+		free(out);
+	}
+	if (bad)
+		fprintf(stderr, "number: %ld doubles changed after a round trip\n", bad);
+}
+
+static const struct
+{
+	const char *name;
+	void (*run)(int n);
+	int counts[4];					/* 没有指定元素个数时的默认值，0 结束 */
+} benches[] = {
+	{ "array", bench_array, { 1000, 10000, 50000 } },
+	{ "lookup", bench_lookup, { 8, 64, 512, 4096 } },
+	{ "writer", bench_writer, { 64, 1024, 16384 } },
+	{ "pull", bench_pull, { 1, 16, 256, 4096 } },
+	{ "threads", bench_threads, { 1, 2, 4, 8 } },
+	{ "string", bench_string, { 64, 1024, 65536, 1048576 } },
+	{ "number", bench_number, { 16, 1024, 65536 } },
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: json_bench array|lookup|writer|pull|threads|string|number [count ...]\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	int counts[16], ncounts = 0, b;
+
+	if (argc < 2)
+		usage();
+	for (b = 0; b < (int)(sizeof(benches) / sizeof(benches[0])); b++) {
+		if (strcmp(argv[1], benches[b].name) == 0)
+			break;
+	}
+	if (b == sizeof(benches) / sizeof(benches[0]))
+		usage();
+	for (int i = 2; i < argc && ncounts < 16; i++)
+		counts[ncounts++] = atoi(argv[i]);
+	if (ncounts == 0) {
+		while (ncounts < 4 && benches[b].counts[ncounts])
+			ncounts++;
+		memcpy(counts, benches[b].counts, sizeof(int) * ncounts);
+	}
+	for (int i = 0; i < ncounts; i++)
+		benches[b].run(counts[i]);
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ *  JSON 库回归测试，失败时打印原因并以非零状态退出，通过时输出一行 JSON。
+ *
+ *  index：对象键数超过 JSON_INDEX_MIN 时 json_get_child 使用哈希索引，
+ *         覆盖 json_set_key 改名后再 detach / attach、json_replace 换成无键元素（应被拒绝），
+ *         以及随机 attach / detach / replace / set_key 序列，每步用逐个比较键的线性查找核对索引结果。
+ *         建议用 -fsanitize=address 编译，索引中残留已释放节点时会直接报错。
+ *  float：浮点数输出为可逐位还原的最短形式，核对 1e23 等 Grisu 无法判定的固定用例，
+ *         以及随机 double 输出后再解析逐位相同、有效数字不多于 %.*e 能还原的最短位数。
+ *
+ *  用法：json_test [随机步数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../json.h"
+
+static int failed;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); failed++; } } while (0)
+
+/*与 json_get_child 相同语义（键不区分大小写，取第一个）的线性查找*/
+static json_t linear_get(json_t o, const char *key)
+{
+	int n = json_get_size(o);
+	for (int i = 0; i < n; i++) {
+		json_t c = json_get_child(o, NULL, i);
+		if (json_key(c) && strcasecmp(json_key(c), key) == 0)
+			return c;
+	}
+	return NULL;
+}
+
+static json_t make_object(int n)
+{
+	json_t o = json_create_object(NULL);
+	char key[16];
+	for (int i = 0; i < n; i++) {
+		sprintf(key, "k%d", i);
+		json_add_int_to_object(o, key, i);
+	}
+	return o;
+}
+
+/*改名后删除：索引中旧键的槽位不能继续指向已释放的节点*/
+static void test_set_key_detach(void)
+{
+	json_t o = make_object(40), c;
+
+	json_get_child(o, "k0", 0);
+	json_set_key(json_get_child(o, NULL, 5), "renamed");
+	json_delete(json_detach(o, NULL, 5));
+	json_attach(o, JSON_TAIL, json_create_int("k5", 100));
+	c = json_get_child(o, "k5", 0);
+	CHECK(c && json_value_int(c) == 100, "set_key+detach: k5 not found after re-attach");
+	CHECK(json_get_child(o, "renamed", 0) == NULL, "set_key+detach: detached key still found");
+	json_delete(o);
+}
+
+/*改名后追加：新键与改名后的键都要能找到*/
+static void test_set_key_attach(void)
+{
+	json_t o = make_object(40), c;
+
+	json_get_child(o, "k0", 0);
+	json_set_key(json_get_child(o, NULL, 7), "k7b");
+	json_attach(o, JSON_TAIL, json_create_int("k7", 700));
+	c = json_get_child(o, "k7", 0);
+	CHECK(c && json_value_int(c) == 700, "set_key+attach: new k7 not found");
+	c = json_get_child(o, "k7b", 0);
+	CHECK(c && json_value_int(c) == 7, "set_key+attach: renamed k7b not found");
+	json_delete(o);
+}
+
+/*对象的成员替换为无键元素：与 json_attach 一样拒绝，对象保持不变*/
+static void test_replace_keyless(void)
+{
+	json_t o = make_object(40), item = json_create_int(NULL, 3), c;
+
+	json_get_child(o, "k0", 0);
+	CHECK(json_replace(o, "k3", 0, item) == NULL, "replace keyless: accepted");
+	json_delete(item);
+	c = json_get_child(o, "k3", 0);
+	CHECK(c && json_value_int(c) == 3, "replace keyless: k3 changed");
+	CHECK(json_get_size(o) == 40, "replace keyless: size changed");
+	json_delete(o);
+}
+
+/*随机修改序列，每步对比索引查找和线性查找*/
+static void test_random(int steps)
+{
+	json_t o = make_object(24);
+	char key[16];
+	int fails = failed;
+
+	srand(1);
+	for (int s = 0; s < steps && failed == fails; s++) {
+		int n = json_get_size(o), op = rand() % 4;
+		int i = n ? rand() % n : 0;
+		sprintf(key, "k%d", rand() % 48);
+		if (op == 0 || n < 20)
+			json_attach(o, rand() % 2 ? JSON_TAIL : rand() % (n + 1), json_create_int(key, s));
+		else if (op == 1)
+			json_delete(json_detach(o, NULL, i));
+		else if (op == 2)
+			json_replace(o, NULL, i, json_create_int(key, s));
+		else
+			json_set_key(json_get_child(o, NULL, i), key);
+		for (int k = 0; k < 48; k++) {
+			sprintf(key, "k%d", k);
+			CHECK(json_get_child(o, key, 0) == linear_get(o, key), "random: step %d op %d lookup %s mismatch", s, op, key);
+		}
+	}
+	json_delete(o);
+}
+
+/*单个浮点数按紧凑格式输出的文本，调用方释放*/
+static char *dump_float(double v)
+{
+	json_t j = json_create_float(NULL, v);
+	char *s = json_dumps(j, 0, 1, NULL);
+	json_delete(j);
+	return s;
+}
+
+/*文本中的有效数字个数，不计前导零和小数点，以及尾部的零*/
+static int sig_digits(const char *s)
+{
+	int n = 0, zeros = 0, started = 0;
+	for (; *s && *s != 'e'; s++) {
+		if (*s < '0' || *s > '9')
+			continue;
+		if (*s != '0')
+			started = 1, n += zeros + 1, zeros = 0;
+		else if (started)
+			zeros++;
+	}
+	return n;
+}
+
+static void test_float(int count)
+{
+	static const struct { double v; const char *text; } cases[] = {
+		{ 1e23, "1e23" }, { 5e-324, "5e-324" }, { 1.7976931348623157e308, "1.7976931348623157e308" },
+		{ 2.2250738585072014e-308, "2.2250738585072014e-308" }, { 0.1, "0.1" }, { 0.3, "0.3" },
+		{ 1e21, "1e21" }, { 1e22, "1e22" }, { 9007199254740993.0, "9007199254740992.0" },
+		{ -1.5e-7, "-1.5e-7" }, { 100.0, "100.0" }, { 0.001234, "0.001234" }, { 2.5e-5, "0.000025" },
+	};
+	char ref[40];
+	int p;
+
+	for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		char *s = dump_float(cases[i].v);
+		CHECK(s && strcmp(s, cases[i].text) == 0, "float: %.17g printed as %s, expected %s", cases[i].v, s, cases[i].text);
+		free(s);
+	}
+	srand(2);
+	for (int i = 0; i < count; i++) {
+		uint64_t bits = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+		double v;
+		char *s;
+		memcpy(&v, &bits, sizeof(v));
+		if (!isfinite(v) || v == 0)
+			continue;
+		/* %.*e 给出的最近 p 位数能还原时 p 位就够了，最短形式不会更长 */
+		for (p = 1; p < 17; p++) {
+			snprintf(ref, sizeof(ref), "%.*e", p - 1, v);
+			if (strtod(ref, NULL) == v)
+				break;
+		}
+		s = dump_float(v);
+		CHECK(strtod(s, NULL) == v, "float: %.17g printed as %s, does not read back", v, s);
+		CHECK(sig_digits(s) <= p, "float: %.17g printed as %s, %d digits are enough", v, s, p);
+		free(s);
+		if (failed)
+			break;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int steps = argc > 1 ? atoi(argv[1]) : 20000;
+
+	test_set_key_detach();
+	test_set_key_attach();
+	test_replace_keyless();
+	test_random(steps);
+	test_float(steps * 10);
+	if (failed)
+		return 1;
+	printf("{\"test\": \"json\", \"random_steps\": %d, \"random_floats\": %d, \"failed\": 0}\n", steps, steps * 10);
+	return 0;
+}
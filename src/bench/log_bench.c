@@ -0,0 +1,136 @@
+/*
+ *  日志路径对比：旧的 printf 直接写标准输出，与新的环形缓冲区 + 后台线程。
+ *  标准输出接到一个按指定速度读取的管道上，模拟 procd / syslog 读得慢的情况，
+ *  每个线程模拟串口线程：写命令、写应答各记录一次，统计每次往返中日志耗费的时间。
+ *
+ *  用法：log_bench printf|ring [读取速度 KB/s，0 表示不限速] [线程数] [每线程往返次数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../tool.h"
+#include "../log.h"
+
+#define ROUND_GAP_USEC (200)	/* 两次往返之间的间隔，模拟串口应答时间 */
+
+static const char cmd[] = "AT+QENG=\"servingcell\"";
+static const char resp[] = "\r\n+QENG: \"servingcell\",\"NOCONN\",\"LTE\",\"FDD\",460,00,1A2B3C4,123,1650,3,5,5,1234,-95,-11,-65,12,-\r\n\r\nOK\r\n";
+
+static int use_ring;
+static int rounds = 5000;
+static long reader_rate;		/* 字节/秒，0 表示不限速 */
+static unsigned long long received;
+
+typedef struct _bench_thread
+{
+	pthread_t thread;
+	unsigned long long *samples;	/* 每次往返的日志耗时（纳秒） */
+} bench_thread;
+
+/*管道读端：每读 4KB 按速度限制休眠*/
+static void *reader(void *arg)
+{
+	int fd = *(int *)arg;
+	char buf[4096];
+	int n;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		__atomic_add_fetch(&received, n, __ATOMIC_RELAXED);
+		if (reader_rate > 0) {
+			struct timespec ts = { 0, (long)((double)n / reader_rate * 1e9) };
+			nanosleep(&ts, NULL);
+		}
+	}
+	return NULL;
+}
+
+static void *worker(void *arg)
+{
+	bench_thread *t = arg;
+	struct timespec gap = { 0, ROUND_GAP_USEC * 1000 };
+	log_site site;
+
+	memset(&site, 0, sizeof(site));
+	for (int i = 0; i < rounds; i++) {
+		unsigned long long start = reckon_nsec();
+		if (use_ring) {
+			/* 不测限流，每次都当作新的调用点 */
+			site.count = 0;
+			log_site_raw(&site, LOGL_DEBUG, "AT>", cmd, sizeof(cmd) - 1, sizeof(cmd) - 1);
+			log_site_raw(&site, LOGL_DEBUG, "AT<", resp, sizeof(resp) - 1, sizeof(resp) - 1);
+		} else {
+			/* 与改动前的 SendAT 相同 */
+			printf("%s\r\n", cmd);
+			printf("%.*s", (int)sizeof(resp) - 1, resp);
+		}
+		t->samples[i] = reckon_nsec() - start;
+		nanosleep(&gap, NULL);
+	}
+	return NULL;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	int nthreads = 4, pfd[2], out;
+	unsigned long long start, elapsed, *all;
+	pthread_t rd;
+	bench_thread *t;
+	long total;
+
+	if (argc < 2 || (strcmp(argv[1], "printf") && strcmp(argv[1], "ring"))) {
+		fprintf(stderr, "usage: log_bench printf|ring [reader KB/s] [threads] [rounds]\n");
+		return 2;
+	}
+	use_ring = strcmp(argv[1], "ring") == 0;
+	if (argc > 2)
+		reader_rate = atol(argv[2]) * 1024;
+	if (argc > 3)
+		nthreads = atoi(argv[3]);
+	if (argc > 4)
+		rounds = atoi(argv[4]);
+
+	/* 标准输出改为管道，结果写到原来的标准输出 */
+	if (pipe(pfd) < 0)
+		return 1;
+	out = dup(STDOUT_FILENO);
+	dup2(pfd[1], STDOUT_FILENO);
+	close(pfd[1]);
+	pthread_create(&rd, NULL, reader, &pfd[0]);
+	if (use_ring)
+		log_init(LOGL_DEBUG, STDOUT_FILENO);
+
+	t = calloc(nthreads, sizeof(bench_thread));
+	all = malloc(sizeof(unsigned long long) * nthreads * rounds);
+	start = reckon_nsec();
+	for (int i = 0; i < nthreads; i++) {
+		t[i].samples = all + (long)i * rounds;
+		pthread_create(&t[i].thread, NULL, worker, &t[i]);
+	}
+	for (int i = 0; i < nthreads; i++)
+		pthread_join(t[i].thread, NULL);
+	elapsed = reckon_nsec() - start;
+	if (use_ring)
+		log_flush();
+	else
+		fflush(stdout);
+
+	total = (long)nthreads * rounds;
+	qsort(all, total, sizeof(all[0]), cmp_ull);
+	dprintf(out, "{\"path\": \"%s\", \"reader_kbps\": %ld, \"threads\": %d, \"rounds\": %ld, "
+		"\"rounds_per_sec\": %.0f, \"log_nsec\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}, "
+		"\"bytes_delivered\": %llu}\n",
+		argv[1], reader_rate / 1024, nthreads, total, total / (elapsed / 1e9),
+		all[total / 2], all[total * 90 / 100], all[total * 99 / 100], all[total * 999 / 1000], all[total - 1],
+		__atomic_load_n(&received, __ATOMIC_RELAXED));
+	return 0;
+}
@@ -0,0 +1,454 @@
+/*
+ *  伪终端模块模拟器：每个模拟模块一个 pty，从站端链接到指定路径，
+ *  服务器用 -d <路径> 或 -a '<路径>*' 打开，与真实的 /dev/ttyUSB* 没有区别。
+ *
+ *  应答由脚本决定，每行一条规则，先匹配的生效：
+ *      <命令> <延迟毫秒[-最大延迟]> [size=字节] [chunk=字节] [gap=毫秒] [result=OK|ERROR|none|hangup] ["应答内容"]
+ *  命令不区分大小写，以 * 结尾时按前缀匹配，单独的 * 匹配所有命令；
+ *  应答内容中 \r \n \" 转义，$IMEI 替换为该模块的 IMEI；size 生成指定大小的应答行；
+ *  chunk / gap 把应答拆成小块慢速写出；result=none 不回结果码，用于测试超时；
+ *  result=hangup 写出应答内容后关闭这个 AT 口，模拟命令执行中模块被拔出。
+ *
+ *  用法：modem_emu [-n 模块数] [-p 每个模块的AT口数] [-l 链接路径前缀] [-s 脚本]
+ *                  [-i 起始IMEI] [-u URC内容] [-U URC间隔毫秒] [-e]
+ */
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <termios.h>
+
+#define MAX_RULES (64)
+#define MAX_PORTS (32)		/* 所有模块的 AT 口总数 */
+#define REPLY_SIZE (1024)
+#define LINE_SIZE (2048)
+
+#define EMU_OK (0)
+#define EMU_ERROR (1)
+#define EMU_SILENT (2)		/* 不回结果码 */
+#define EMU_HANGUP (3)		/* 不回结果码并关闭 AT 口 */
+
+typedef struct _emu_rule
+{
+	char cmd[64];
+	int prefix;					/* 以 * 结尾，按前缀匹配 */
+	int latency_min, latency_max;	/* 毫秒 */
+	int size;					/* >0 时生成该大小的应答 */
+	int chunk;					/* 每次写出的字节数，0 表示一次写完 */
+	int gap;					/* 两块之间的间隔（毫秒） */
+	int result;
+	char reply[REPLY_SIZE];
+} emu_rule;
+
+/* 一个 AT 口，同一模块的各个口应答相同的 IMEI，URC 只从第一个口上报 */
+typedef struct _emu_port
+{
+	pthread_t thread;
+	int master, slave;
+	char link[256];
+	char imei[20];
+	int urc;
+	unsigned int seed;
+	unsigned long long next_urc;	/* 下一次主动上报的时间（毫秒） */
+} emu_port;
+
+static emu_rule rules[MAX_RULES];
+static int nrules;
+static emu_port ports[MAX_PORTS];
+static int nports;
+static const char *urc;
+static int urc_period;
+static int echo;
+
+static const char *default_script[] = {
+	"AT+CGSN 10 \"$IMEI\"",
+	"AT+GSN 10 \"$IMEI\"",
+	"ATI 10 \"Quectel\\r\\nEC20F\\r\\nRevision: EC20CEFAGR06A05M4G\"",
+	"AT+CSQ 10 \"+CSQ: 23,99\"",
+	"AT+COPS? 10 \"+COPS: 0,0,\\\"CHN-UNICOM\\\",7\"",
+	"AT+COPS=? 500 size=1600",
+	"AT+CFUN=* 50",
+	"* 10",
+	NULL
+};
+
+static unsigned long long now_msec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_msec(int ms)
+{
+	struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+	while (ms > 0 && nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+/*应答内容：去掉引号并处理 \r \n \" \\ 转义*/
+static void unquote(char *dst, int size, const char *src)
+{
+	int n = 0;
+	for (src++; *src && *src != '"' && n < size - 1; src++) {
+		if (*src == '\\' && src[1]) {
+			src++;
+			dst[n++] = *src == 'r' ? '\r' : *src == 'n' ? '\n' : *src;
+		} else {
+			dst[n++] = *src;
+		}
+	}
+	dst[n] = '\0';
+}
+
+static int parse_rule(const char *line, emu_rule *r)
+{
+	char tok[REPLY_SIZE];
+	const char *p = line;
+	int n, field = 0;
+
+	memset(r, 0, sizeof(*r));
+	while (*p) {
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (!*p || *p == '#' || *p == '\n' || *p == '\r')
+			break;
+		if (*p == '"') {
+			/* 引号内可以有空格 */
+			const char *q = p + 1;
+			while (*q && *q != '"')
+				q += *q == '\\' && q[1] ? 2 : 1;
+			unquote(r->reply, sizeof(r->reply), p);
+			p = *q ? q + 1 : q;
+			continue;
+		}
+		for (n = 0; *p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' && n < (int)sizeof(tok) - 1; p++)
+			tok[n++] = *p;
+		tok[n] = '\0';
+		if (field == 0) {
+			n = strlen(tok);
+			r->prefix = n > 0 && tok[n - 1] == '*';
+			if (r->prefix)
+				tok[n - 1] = '\0';
+			snprintf(r->cmd, sizeof(r->cmd), "%s", tok);
+		} else if (field == 1) {
+			char *dash;
+			r->latency_min = r->latency_max = atoi(tok);
+			if ((dash = strchr(tok, '-')) != NULL)
+				r->latency_max = atoi(dash + 1);
+		} else if (strncmp(tok, "size=", 5) == 0) {
+			r->size = atoi(tok + 5);
+		} else if (strncmp(tok, "chunk=", 6) == 0) {
+			r->chunk = atoi(tok + 6);
+		} else if (strncmp(tok, "gap=", 4) == 0) {
+			r->gap = atoi(tok + 4);
+		} else if (strncmp(tok, "result=", 7) == 0) {
+			r->result = strcasecmp(tok + 7, "ERROR") == 0 ? EMU_ERROR : strcasecmp(tok + 7, "none") == 0 ? EMU_SILENT :
+				strcasecmp(tok + 7, "hangup") == 0 ? EMU_HANGUP : EMU_OK;
+		} else {
+			fprintf(stderr, "unknown field '%s' in: %s", tok, line);
+			return -1;
+		}
+		field++;
+	}
+	return field >= 2 ? 0 : -1;
+}
+
+static int add_rule(const char *line)
+{
+	if (nrules >= MAX_RULES || parse_rule(line, &rules[nrules]) < 0)
+		return -1;
+	nrules++;
+	return 0;
+}
+
+static int load_script(const char *path)
+{
+	char line[LINE_SIZE];
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		char *p = line;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || !*p)
+			continue;
+		if (add_rule(p) < 0) {
+			fprintf(stderr, "bad rule: %s", line);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static emu_rule *match(const char *cmd)
+{
+	for (int i = 0; i < nrules; i++) {
+		emu_rule *r = &rules[i];
+		int n = strlen(r->cmd);
+		if (r->prefix ? strncasecmp(cmd, r->cmd, n) == 0 : strcasecmp(cmd, r->cmd) == 0)
+			return r;
+	}
+	return NULL;
+}
+
+static void write_all(int fd, const char *p, int len)
+{
+	while (len > 0) {
+		int n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		p += n;
+		len -= n;
+	}
+}
+
+/*按规则拆块写出，chunk 为 0 时一次写完*/
+static void deliver(int fd, const char *p, int len, const emu_rule *r)
+{
+	int chunk = r->chunk > 0 ? r->chunk : len;
+	while (len > 0) {
+		int n = len < chunk ? len : chunk;
+		write_all(fd, p, n);
+		p += n;
+		len -= n;
+		if (len > 0 && r->gap > 0)
+			sleep_msec(r->gap);
+	}
+}
+
+static void send_urc(emu_port *m)
+{
+	char buf[LINE_SIZE];
+	int n = snprintf(buf, sizeof(buf), "\r\n%s\r\n", urc);
+	write_all(m->master, buf, n);
+	m->next_urc = now_msec() + urc_period;
+}
+
+/*组装应答：\r\n内容\r\n\r\n结果码\r\n，与模块的 ATV1 格式一致*/
+static int build_reply(emu_port *m, const emu_rule *r, char **out)
+{
+	/* $IMEI 展开后最多变为 3 倍，生成的最后一行可能超出 size 一行 */
+	int cap = REPLY_SIZE * 3 + r->size + 128, n = 0, line = 0, target;
+	char *buf = malloc(cap);
+	const char *p;
+
+	if (!buf)
+		return -1;
+	if (r->reply[0]) {
+		buf[n++] = '\r';
+		buf[n++] = '\n';
+		for (p = r->reply; *p; p++) {
+			if (strncmp(p, "$IMEI", 5) == 0) {
+				n += sprintf(buf + n, "%s", m->imei);
+				p += 4;
+			} else {
+				buf[n++] = *p;
+			}
+		}
+		buf[n++] = '\r';
+		buf[n++] = '\n';
+	}
+	/* 大应答：逐行填充到 size 字节 */
+	for (target = n + r->size; n < target; ) {
+		n += snprintf(buf + n, cap - n, "\r\n+QDATA: %d,\"%.48s\"\r\n", line++,
+			"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ");
+	}
+	if (r->result == EMU_OK)
+		n += sprintf(buf + n, "\r\nOK\r\n");
+	else if (r->result == EMU_ERROR)
+		n += sprintf(buf + n, "\r\nERROR\r\n");
+	*out = buf;
+	return n;
+}
+
+/*返回 <0 表示 AT 口已关闭*/
+static int handle_cmd(emu_port *m, const char *cmd)
+{
+	emu_rule *r = match(cmd);
+	char *reply;
+	int latency, n;
+
+	if (echo) {
+		write_all(m->master, cmd, strlen(cmd));
+		write_all(m->master, "\r", 1);
+	}
+	if (!r)
+		return 0;
+	latency = r->latency_min;
+	if (r->latency_max > r->latency_min)
+		latency += rand_r(&m->seed) % (r->latency_max - r->latency_min + 1);
+	sleep_msec(latency);
+	/* 到期的 URC 插在应答之前，正好落在服务器等待应答的时候 */
+	if (m->urc && now_msec() >= m->next_urc)
+		send_urc(m);
+	if ((n = build_reply(m, r, &reply)) < 0)
+		return 0;
+	deliver(m->master, reply, n, r);
+	free(reply);
+	if (r->result == EMU_HANGUP) {
+		/* 主端和自己持有的从站端都关闭，服务器的从站端随即收到 POLLHUP */
+		printf("%s hang up after %s\n", m->link, cmd);
+		fflush(stdout);
+		close(m->master);
+		close(m->slave);
+		unlink(m->link);
+		return -1;
+	}
+	return 0;
+}
+
+static void *emu_thread(void *arg)
+{
+	emu_port *m = arg;
+	char buf[LINE_SIZE];
+	int len = 0;
+
+	m->next_urc = now_msec() + urc_period;
+	for (;;) {
+		struct pollfd pfd = { m->master, POLLIN, 0 };
+		int timeout = -1, n, i, start;
+		if (m->urc) {
+			unsigned long long now = now_msec();
+			timeout = m->next_urc > now ? (int)(m->next_urc - now) : 0;
+		}
+		n = poll(&pfd, 1, timeout);
+		if (n == 0) {
+			send_urc(m);
+			continue;
+		}
+		if (n < 0 || !(pfd.revents & POLLIN)) {
+			sleep_msec(10);
+			continue;
+		}
+		if ((n = read(m->master, buf + len, sizeof(buf) - 1 - len)) <= 0)
+			continue;
+		len += n;
+		/* 按 \r 或 \n 切分命令，不完整的留到下次 */
+		for (i = 0, start = 0; i < len; i++) {
+			if (buf[i] != '\r' && buf[i] != '\n')
+				continue;
+			buf[i] = '\0';
+			if (i > start && handle_cmd(m, buf + start) < 0)
+				return NULL;
+			start = i + 1;
+		}
+		len -= start;
+		memmove(buf, buf + start, len);
+		if (len >= (int)sizeof(buf) - 1)
+			len = 0;
+	}
+	return NULL;
+}
+
+static int emu_open(emu_port *m)
+{
+	struct termios tio;
+	char *name;
+
+	if ((m->master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(m->master) < 0 || unlockpt(m->master) < 0)
+		return -1;
+	if (!(name = ptsname(m->master)))
+		return -1;
+	/* 自己也打开从站端，服务器关闭重开时主站端不会收到 EIO */
+	if ((m->slave = open(name, O_RDWR | O_NOCTTY)) < 0)
+		return -1;
+	tcgetattr(m->slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(m->slave, TCSANOW, &tio);
+	unlink(m->link);
+	if (symlink(name, m->link) < 0) {
+		perror(m->link);
+		return -1;
+	}
+	printf("%s -> %s IMEI %s\n", m->link, name, m->imei);
+	return 0;
+}
+
+static void cleanup(int sig)
+{
+	(void)sig;
+	for (int i = 0; i < nports; i++)
+		unlink(ports[i].link);
+	_exit(0);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: modem_emu [options]\n"
+		"\t-n <modems> (default: 1)\n"
+		"\t-p <AT ports per modem> (default: 1)\n"
+		"\t-l <link prefix> (default: /tmp/ttyEMU, links are <prefix>0, <prefix>1, ...)\n"
+		"\t-s <script> response rules, see the top of modem_emu.c\n"
+		"\t-i <first IMEI> (default: 860000000000000, one more per modem)\n"
+		"\t-u <URC text> e.g. '+QIND: \"csq\",20,99'\n"
+		"\t-U <URC period in ms> (default: 1000)\n"
+		"\t-e echo commands like ATE1\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *prefix = "/tmp/ttyEMU", *script = NULL;
+	unsigned long long imei = 860000000000000ULL;
+	int ch, nmodems = 1, per = 1;
+
+	urc_period = 1000;
+	while ((ch = getopt(argc, argv, "n:p:l:s:i:u:U:eh")) != -1) {
+		switch (ch) {
+		case 'n': nmodems = atoi(optarg); break;
+		case 'p': per = atoi(optarg); break;
+		case 'l': prefix = optarg; break;
+		case 's': script = optarg; break;
+		case 'i': imei = strtoull(optarg, NULL, 10); break;
+		case 'u': urc = optarg; break;
+		case 'U': urc_period = atoi(optarg); break;
+		case 'e': echo = 1; break;
+		default: usage();
+		}
+	}
+	if (nmodems < 1 || per < 1 || nmodems * per > MAX_PORTS || urc_period <= 0)
+		usage();
+	if (script ? load_script(script) < 0 : 0)
+		return 1;
+	for (int i = 0; !script && default_script[i]; i++)
+		add_rule(default_script[i]);
+
+	signal(SIGINT, cleanup);
+	signal(SIGTERM, cleanup);
+	signal(SIGPIPE, SIG_IGN);
+	for (int i = 0; i < nmodems * per; i++) {
+		emu_port *m = &ports[nports++];
+		snprintf(m->link, sizeof(m->link), "%s%d", prefix, i);
+		snprintf(m->imei, sizeof(m->imei), "%llu", imei + i / per);
+		m->urc = urc && i % per == 0;
+		m->seed = i + 1;
+		if (emu_open(m) < 0) {
+			fprintf(stderr, "create pty for %s failed: %s\n", m->link, strerror(errno));
+			cleanup(0);
+		}
+	}
+	fflush(stdout);
+	for (int i = 0; i < nports; i++)
+		pthread_create(&ports[i].thread, NULL, emu_thread, &ports[i]);
+	for (int i = 0; i < nports; i++)
+		pthread_join(ports[i].thread, NULL);
+	return 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# 端到端压测：启动模拟模块和服务器，用 http_load 跑一组负载，结果以 JSON 输出到标准输出。
+# 环境变量：BENCH_SECS 每项时长（默认 5 秒），BENCH_CONNS 连接数（默认 32），BENCH_PORT 服务器端口（默认 18888），
+#           BENCH_IDLE 空闲长连接数（默认 1000，需要相应的文件描述符上限）
+#
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${BENCH_SECS:-5}
+CONNS=${BENCH_CONNS:-32}
+IDLE=${BENCH_IDLE:-1000}
+PORT=${BENCH_PORT:-18888}
+LINK=/tmp/ttyBENCH
+EMU=
+SRV=
+FIRST=1
+
+stop() {
+	[ -n "$SRV" ] && kill "$SRV" 2>/dev/null && wait "$SRV" 2>/dev/null
+	[ -n "$EMU" ] && kill "$EMU" 2>/dev/null && wait "$EMU" 2>/dev/null
+	SRV=
+	EMU=
+}
+trap 'stop; exit 1' INT TERM
+
+# start <模块数>：每个模块两个 AT 口
+start() {
+	./bench/modem_emu -n "$1" -p 2 -l $LINK -s bench/bench.script > /dev/null &
+	EMU=$!
+	sleep 0.3
+	./ATTool_APIServer -p "$PORT" -l warn -a "$LINK*" > /tmp/attool_bench.log 2>&1 &
+	SRV=$!
+	sleep 1
+	if ! kill -0 "$SRV" 2>/dev/null; then
+		echo "server failed to start, see /tmp/attool_bench.log" >&2
+		stop
+		exit 1
+	fi
+}
+
+# run <名称> <http_load 参数...>
+run() {
+	name=$1
+	shift
+	[ $FIRST = 1 ] || printf ',\n'
+	FIRST=0
+	printf '    '
+	./bench/http_load -p "$PORT" -c "$CONNS" -d "$SECS" -n "$name" -P "$SRV" "$@" | tr -d '\n'
+	echo "  $name" >&2
+}
+
+POLL="/AT+CSQ:4 /AT+CREG?:2 /AT+COPS?:2 /ATI:1 /AT+CGSN:1"
+
+printf '{\n  "commit": "%s",\n  "date": "%s",\n  "seconds": %s,\n  "results": [\n' \
+	"$(git rev-parse --short HEAD 2>/dev/null)" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$SECS"
+
+start 1
+run poll_keepalive -k $POLL
+run poll_close -K $POLL
+# 活动连接之外保持大量空闲长连接，输出中 idle.held 为服务器保持住的个数
+run poll_idle -k -i "$IDLE" $POLL
+run poll_nocache -k "/AT+CSQ?nocache=1:1" "/AT+CPAS:1"
+run mixed_rw -k "/AT+CSQ:6" "/AT+CREG?:2" "/AT+CPAS:1" "/AT+CMEE=2:1"
+run large_json -k "/AT+QLTS?"
+run large_raw -k "/AT+QLTS??raw=1"
+stop
+
+# 吞吐量随模块数的变化：只读查询会合并成一次串口命令，这里用不合并的设置命令平均分到各模块
+for n in 1 2 4; do
+	start $n
+	paths=
+	i=0
+	while [ $i -lt $n ]; do
+		paths="$paths /modem/$i/AT+CMEE=2"
+		i=$((i + 1))
+	done
+	run "scale_${n}_modems" -k $paths
+	stop
+done
+
+printf '\n  ]\n}\n'
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# 长时间压测：分轮发送请求直到累计 SOAK_REQUESTS 个（默认一百万），每轮输出一行 JSON 记录服务器 RSS。
+# 第一轮作为预热，之后 RSS 增长超过 SOAK_MAX_GROWTH_KB（默认 2048）时以非零状态退出。
+# 环境变量：SOAK_ROUND 每轮秒数（默认 10），BENCH_CONNS 连接数（默认 32），BENCH_PORT 服务器端口（默认 18888）
+#
+cd "$(dirname "$0")/.." || exit 1
+
+TOTAL=${SOAK_REQUESTS:-1000000}
+ROUND=${SOAK_ROUND:-10}
+MAX_GROWTH=${SOAK_MAX_GROWTH_KB:-2048}
+CONNS=${BENCH_CONNS:-32}
+PORT=${BENCH_PORT:-18888}
+LINK=/tmp/ttySOAK
+
+stop() {
+	kill "$SRV" "$EMU" 2>/dev/null
+	wait 2>/dev/null
+}
+trap 'stop; exit 1' INT TERM
+
+./bench/modem_emu -n 1 -p 2 -l $LINK -s bench/bench.script > /dev/null &
+EMU=$!
+sleep 0.3
+./ATTool_APIServer -p "$PORT" -l warn -a "$LINK*" > /tmp/attool_soak.log 2>&1 &
+SRV=$!
+sleep 1
+if ! kill -0 "$SRV" 2>/dev/null; then
+	echo "server failed to start, see /tmp/attool_soak.log" >&2
+	stop
+	exit 1
+fi
+
+# 覆盖每条会分配 JSON 树的路径：缓存命中、串口应答、大应答、状态页、各种 404
+PATHS="/AT+CSQ:20 /AT+CREG?:10 /AT+CMEE=2:2 /AT+QLTS?:1 /status:2 /modem/9/AT:1 /AT+CMGL=4:1 /foo:1"
+
+done_reqs=0
+round=0
+base=
+rss=0
+while [ "$done_reqs" -lt "$TOTAL" ]; do
+	round=$((round + 1))
+	line=$(./bench/http_load -p "$PORT" -c "$CONNS" -d "$ROUND" -n "soak_$round" -P "$SRV" $PATHS)
+	reqs=$(echo "$line" | sed -n 's/.*"requests": \([0-9]*\).*/\1/p')
+	rss=$(echo "$line" | sed -n 's/.*"rss_kb": \([0-9]*\).*/\1/p')
+	done_reqs=$((done_reqs + ${reqs:-0}))
+	[ -n "$base" ] || base=$rss
+	echo "{\"round\": $round, \"total_requests\": $done_reqs, \"rss_kb\": $rss, \"load\": $line}"
+done
+stop
+
+growth=$((rss - base))
+echo "{\"total_requests\": $done_reqs, \"rss_after_warmup_kb\": $base, \"rss_final_kb\": $rss, \"growth_kb\": $growth}"
+[ "$growth" -le "$MAX_GROWTH" ]
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "cache.h"
+#include "tool.h"
+#include "atcmd.h"
+#include "metrics.h"
+
+/*AT 命令不区分大小写，按大写计算哈希*/
+static unsigned int cmd_hash(const char *cmd)
+{
+	unsigned int h = 2166136261u;
+	for (; *cmd; cmd++)
+		h = (h ^ (unsigned char)toupper((unsigned char)*cmd)) * 16777619u;
+	return h;
+}
+
+static cache_entry **cache_find(at_cache *c, const char *cmd, unsigned int h)
+{
+	cache_entry **pe = &c->buckets[h % AT_CACHE_BUCKETS];
+	for (; *pe; pe = &(*pe)->next) {
+		if ((*pe)->hash == h && strcasecmp((*pe)->cmd, cmd) == 0)
+			break;
+	}
+	return pe;
+}
+
+void cache_init(at_cache *c)
+{
+	memset(c, 0, sizeof(at_cache));
+	pthread_mutex_init(&c->lock, NULL);
+}
+
+/*
+ *  查找未过期且不早于 max_age 毫秒（<0 表示不限制）的应答，命中时返回新增的引用，
+ *  age 返回应答已缓存的毫秒数。
+ */
+at_resp *cache_get(at_cache *c, const char *cmd, long max_age, long *age)
+{
+	unsigned long long now = reckon_usec();
+	unsigned int h = cmd_hash(cmd);
+	at_resp *resp = NULL;
+	cache_entry *e;
+
+	pthread_mutex_lock(&c->lock);
+	e = *cache_find(c, cmd, h);
+	if (e && (!e->expires || e->expires > now) && (max_age < 0 || now - e->stored <= (unsigned long long)max_age * 1000)) {
+		resp = at_resp_ref(e->resp);
+		if (age)
+			*age = (now - e->stored) / 1000;
+	}
+	pthread_mutex_unlock(&c->lock);
+	__atomic_add_fetch(resp ? &c->hits : &c->misses, 1, __ATOMIC_RELAXED);
+	metric_inc(*(resp ? &metrics.cache_hits : &metrics.cache_misses));
+	return resp;
+}
+
+/*
+ *  保存应答，ttl 为毫秒，AT_TTL_FOREVER 表示一直有效；缓存持有一个引用。
+ *  gen 为提交命令时的 cache_generation，其间执行过改变状态的命令时应答可能已过时，不保存。
+ */
+void cache_put(at_cache *c, const char *cmd, at_resp *resp, int ttl, unsigned long gen)
+{
+	unsigned long long now = reckon_usec();
+	unsigned int h = cmd_hash(cmd);
+	cache_entry **pe, *e;
+	at_resp *old = NULL;
+
+	pthread_mutex_lock(&c->lock);
+	if (c->generation != gen) {
+		pthread_mutex_unlock(&c->lock);
+		return;
+	}
+	pe = cache_find(c, cmd, h);
+	e = *pe;
+	if (!e) {
+		e = calloc(1, sizeof(cache_entry) + strlen(cmd) + 1);
+		if (!e) {
+			pthread_mutex_unlock(&c->lock);
+			return;
+		}
+		e->hash = h;
+		strcpy(e->cmd, cmd);
+		*pe = e;
+	}
+	old = e->resp;
+	e->resp = at_resp_ref(resp);
+	e->stored = now;
+	e->expires = ttl == AT_TTL_FOREVER ? 0 : now + (unsigned long long)ttl * 1000;
+	pthread_mutex_unlock(&c->lock);
+	at_resp_unref(old);
+}
+
+/*执行了可能改变模块状态的命令，丢弃所有缓存*/
+void cache_clear(at_cache *c)
+{
+	cache_entry *e, *next, *list = NULL;
+	int i;
+
+	pthread_mutex_lock(&c->lock);
+	c->generation++;
+	for (i = 0; i < AT_CACHE_BUCKETS; i++) {
+		for (e = c->buckets[i]; e; e = next) {
+			next = e->next;
+			e->next = list;
+			list = e;
+		}
+		c->buckets[i] = NULL;
+	}
+	pthread_mutex_unlock(&c->lock);
+	for (e = list; e; e = next) {
+		next = e->next;
+		at_resp_unref(e->resp);
+		free(e);
+	}
+}
+
+/*当前的缓存代数，提交命令前记下，交给 cache_put*/
+unsigned long cache_generation(at_cache *c)
+{
+	unsigned long gen;
+
+	pthread_mutex_lock(&c->lock);
+	gen = c->generation;
+	pthread_mutex_unlock(&c->lock);
+	return gen;
+}
+
+/*
+ *  相同的只读命令正在执行时把 f 挂到该命令上并返回 1，由领头请求完成后统一应答；
+ *  否则 f 成为领头请求并返回 0，调用方负责提交串口任务。
+ */
+int flight_join(at_cache *c, at_flight *f, const char *cmd)
+{
+	unsigned int h = cmd_hash(cmd);
+	at_flight **pf;
+
+	f->hash = h;
+	f->cmd = cmd;
+	f->followers = NULL;
+	pthread_mutex_lock(&c->lock);
+	for (pf = &c->flights[h % AT_CACHE_BUCKETS]; *pf; pf = &(*pf)->next) {
+		if ((*pf)->hash == h && strcasecmp((*pf)->cmd, cmd) == 0)
+			break;
+	}
+	if (*pf) {
+		f->next = (*pf)->followers;
+		(*pf)->followers = f;
+		pthread_mutex_unlock(&c->lock);
+		__atomic_add_fetch(&c->coalesced, 1, __ATOMIC_RELAXED);
+		metric_inc(metrics.coalesced);
+		return 1;
+	}
+	f->next = NULL;
+	*pf = f;
+	pthread_mutex_unlock(&c->lock);
+	return 0;
+}
+
+/*领头请求完成：移出进行中列表，返回等待同一应答的请求*/
+at_flight *flight_finish(at_cache *c, at_flight *leader)
+{
+	at_flight **pf, *followers;
+
+	pthread_mutex_lock(&c->lock);
+	for (pf = &c->flights[leader->hash % AT_CACHE_BUCKETS]; *pf && *pf != leader; pf = &(*pf)->next)
+		;
+	if (*pf)
+		*pf = leader->next;
+	followers = leader->followers;
+	leader->followers = NULL;
+	pthread_mutex_unlock(&c->lock);
+	return followers;
+}
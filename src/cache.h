@@ -0,0 +1,49 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include "atbuf.h"
+
+#define AT_CACHE_BUCKETS (64)	/* 可缓存的命令是 atcmd.c 中的固定集合，不需要淘汰 */
+
+/* 缓存的应答，引用计数共享给各个请求 */
+typedef struct _cache_entry
+{
+	struct _cache_entry *next;
+	unsigned int hash;
+	at_resp *resp;
+	unsigned long long stored;		/* 写入时间（微秒） */
+	unsigned long long expires;		/* 过期时间，0 表示一直有效 */
+	char cmd[];
+} cache_entry;
+
+/* 正在串口上执行的只读命令，嵌入请求结构体，相同命令的后续请求挂在 followers 上 */
+typedef struct _at_flight
+{
+	struct _at_flight *next;		/* 哈希链，跟随者之间也用它串起来 */
+	struct _at_flight *followers;
+	unsigned int hash;
+	const char *cmd;
+} at_flight;
+
+/* 每个模块一个应答缓存，由网络线程访问 */
+typedef struct _at_cache
+{
+	pthread_mutex_t lock;
+	cache_entry *buckets[AT_CACHE_BUCKETS];
+	at_flight *flights[AT_CACHE_BUCKETS];
+	unsigned long hits;				/* 原子计数 */
+	unsigned long misses;
+	unsigned long coalesced;		/* 合并到进行中命令的请求数 */
+	unsigned long generation;		/* 每次 cache_clear 加一，提交前记下，应答回来时不同则不再写入 */
+} at_cache;
+
+void cache_init(at_cache *c);
+at_resp *cache_get(at_cache *c, const char *cmd, long max_age, long *age);
+void cache_put(at_cache *c, const char *cmd, at_resp *resp, int ttl, unsigned long gen);
+void cache_clear(at_cache *c);
+unsigned long cache_generation(at_cache *c);
+int flight_join(at_cache *c, at_flight *f, const char *cmd);
+at_flight *flight_finish(at_cache *c, at_flight *leader);
+
+#endif
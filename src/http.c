@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "http.h"
+
+/* 解析状态 */
+enum
+{
+	S_METHOD = 0,
+	S_TARGET,
+	S_VERSION,
+	S_LINE_LF,
+	S_HDR_START,
+	S_HDR_NAME,
+	S_HDR_OWS,
+	S_HDR_VALUE,
+	S_HDR_LF,
+	S_END_LF,
+	S_BODY,
+};
+
+#define F_CONN_CLOSE (1 << 0)
+#define F_CONN_KEEP (1 << 1)
+
+#define slice_set(s, b, from, to) ((s).p = (b) + (from), (s).len = (to) - (from))
+
+/*请求头名与值为 token 字符*/
+static int is_token(unsigned char ch)
+{
+	return ch > ' ' && ch < 0x7f && !strchr("()<>@,;:\\\"/[]?={}", ch);
+}
+
+/*
+ *  AT 命令本身常带 '?'（AT+CREG?、AT+COPS=?），只有最后一个 '?' 后面是 name=value
+ *  形式时才当作查询串，例如 /AT+CREG??timing=1
+ */
+static const char *query_start(const char *p, int len)
+{
+	const char *q = p + len, *v;
+	while (q > p && q[-1] != '?')
+		q--;
+	if (q == p)
+		return NULL;
+	for (v = q; v < p + len && (isalnum((unsigned char)*v) || *v == '_' || *v == '-' || *v == '.'); v++)
+		;
+	if (v == q || v >= p + len || *v != '=')
+		return NULL;
+	return q - 1;
+}
+
+void http_reset(http_request *r)
+{
+	memset(r, 0, sizeof(http_request));
+}
+
+/*不区分大小写比较片段与字符串*/
+int slice_case_equal(const http_slice *s, const char *str)
+{
+	int n = strlen(str);
+	return s->p && s->len == n && strncasecmp(s->p, str, n) == 0;
+}
+
+/*一个请求头解析完成，记录并识别关心的头*/
+static int header_done(http_request *r, const char *buf, int end)
+{
+	http_header *h;
+	const char *v;
+	int i;
+
+	while (end > r->mark && (buf[end - 1] == ' ' || buf[end - 1] == '\t'))
+		end--;
+	if (r->nheaders >= HTTP_MAX_HEADERS)
+		return HTTP_TOO_MANY;
+	h = &r->headers[r->nheaders++];
+	slice_set(h->value, buf, r->mark, end);
+
+	if (slice_case_equal(&h->name, "Connection")) {
+		/* 值可能是逗号分隔的列表 */
+		for (v = h->value.p; v < h->value.p + h->value.len; v++) {
+			if (h->value.p + h->value.len - v >= 5 && strncasecmp(v, "close", 5) == 0)
+				r->flags |= F_CONN_CLOSE;
+			else if (h->value.p + h->value.len - v >= 10 && strncasecmp(v, "keep-alive", 10) == 0)
+				r->flags |= F_CONN_KEEP;
+		}
+	} else if (slice_case_equal(&h->name, "Content-Length")) {
+		if (h->value.len == 0 || h->value.len > 9)
+			return HTTP_ERROR;
+		r->content_length = 0;
+		for (i = 0; i < h->value.len; i++) {
+			if (h->value.p[i] < '0' || h->value.p[i] > '9')
+				return HTTP_ERROR;
+			r->content_length = r->content_length * 10 + h->value.p[i] - '0';
+		}
+	} else if (slice_case_equal(&h->name, "Transfer-Encoding")) {
+		return HTTP_ERROR; /* 不支持分块请求体 */
+	}
+	return 0;
+}
+
+static int version_done(http_request *r, const char *buf, int end)
+{
+	if (end - r->mark != 8 || memcmp(buf + r->mark, "HTTP/1.", 7) != 0)
+		return HTTP_ERROR;
+	if (buf[r->mark + 7] == '1')
+		r->version = 11;
+	else if (buf[r->mark + 7] == '0')
+		r->version = 10;
+	else
+		return HTTP_ERROR;
+	return 0;
+}
+
+/*
+ *  增量解析 buf 中的请求，buf 为同一连接的接收缓冲区，两次调用之间不能移动。
+ *  每次调用从上次停下的位置继续，请求完整时返回请求总长度（请求头 + 请求体），
+ *  数据不够返回 HTTP_AGAIN，格式错误返回 HTTP_ERROR / HTTP_TOO_MANY。
+ */
+int http_parse(http_request *r, const char *buf, int len)
+{
+	const char *q;
+	int ret;
+
+	while (r->state != S_BODY && r->pos < len) {
+		unsigned char ch = buf[r->pos];
+		switch (r->state) {
+		case S_METHOD:
+			if (ch == ' ' && r->pos > r->mark) {
+				slice_set(r->method, buf, r->mark, r->pos);
+				r->mark = r->pos + 1;
+				r->state = S_TARGET;
+			} else if ((ch == '\r' || ch == '\n') && r->pos == r->mark) {
+				r->mark++; /* 忽略请求之间多余的空行 */
+			} else if (!is_token(ch)) {
+				return HTTP_ERROR;
+			}
+			break;
+		case S_TARGET:
+			if (ch == ' ' && r->pos > r->mark) {
+				slice_set(r->target, buf, r->mark, r->pos);
+				q = query_start(r->target.p, r->target.len);
+				if (q) {
+					slice_set(r->path, buf, r->mark, q - buf);
+					slice_set(r->query, buf, q - buf + 1, r->pos);
+				} else {
+					r->path = r->target;
+				}
+				r->mark = r->pos + 1;
+				r->state = S_VERSION;
+			} else if (ch <= ' ' || ch == 0x7f) {
+				return HTTP_ERROR;
+			}
+			break;
+		case S_VERSION:
+			if (ch == '\r' || ch == '\n') {
+				if (version_done(r, buf, r->pos) < 0)
+					return HTTP_ERROR;
+				r->state = (ch == '\r') ? S_LINE_LF : S_HDR_START;
+			}
+			break;
+		case S_LINE_LF:
+		case S_HDR_LF:
+			if (ch != '\n')
+				return HTTP_ERROR;
+			r->state = S_HDR_START;
+			break;
+		case S_HDR_START:
+			if (ch == '\r') {
+				r->state = S_END_LF;
+			} else if (ch == '\n') {
+				r->state = S_BODY;
+			} else if (is_token(ch)) {
+				r->mark = r->pos;
+				r->state = S_HDR_NAME;
+			} else {
+				return HTTP_ERROR;
+			}
+			break;
+		case S_HDR_NAME:
+			if (ch == ':') {
+				if (r->nheaders < HTTP_MAX_HEADERS)
+					slice_set(r->headers[r->nheaders].name, buf, r->mark, r->pos);
+				r->state = S_HDR_OWS;
+			} else if (!is_token(ch)) {
+				return HTTP_ERROR;
+			}
+			break;
+		case S_HDR_OWS:
+			if (ch == ' ' || ch == '\t')
+				break;
+			r->mark = r->pos;
+			r->state = S_HDR_VALUE;
+			/* fall through */
+		case S_HDR_VALUE:
+			if (ch == '\r' || ch == '\n') {
+				if ((ret = header_done(r, buf, r->pos)) < 0)
+					return ret;
+				r->state = (ch == '\r') ? S_HDR_LF : S_HDR_START;
+			}
+			break;
+		case S_END_LF:
+			if (ch != '\n')
+				return HTTP_ERROR;
+			r->state = S_BODY;
+			break;
+		}
+		r->pos++;
+		if (r->state == S_BODY) {
+			/* 请求头结束 */
+			r->header_length = r->pos;
+			if (r->version == 11)
+				r->keepalive = !(r->flags & F_CONN_CLOSE);
+			else
+				r->keepalive = (r->flags & F_CONN_KEEP) && !(r->flags & F_CONN_CLOSE);
+		}
+	}
+
+	if (r->state != S_BODY || len - r->header_length < r->content_length)
+		return HTTP_AGAIN;
+	slice_set(r->body, buf, r->header_length, r->header_length + r->content_length);
+	return r->header_length + r->content_length;
+}
+
+/*按名称查找请求头，不区分大小写*/
+const http_slice *http_header_get(const http_request *r, const char *name)
+{
+	int i;
+	for (i = 0; i < r->nheaders; i++) {
+		if (slice_case_equal(&r->headers[i].name, name))
+			return &r->headers[i].value;
+	}
+	return NULL;
+}
+
+/*在查询串中查找参数，值仍指向接收缓冲区（未解码）；参数存在返回 1*/
+int http_query_get(const http_request *r, const char *name, http_slice *value)
+{
+	const char *p = r->query.p, *end = r->query.p + r->query.len, *amp, *eq;
+	int n = strlen(name);
+
+	if (!p)
+		return 0;
+	while (p < end) {
+		amp = memchr(p, '&', end - p);
+		if (!amp)
+			amp = end;
+		eq = memchr(p, '=', amp - p);
+		if ((eq ? eq : amp) - p == n && strncmp(p, name, n) == 0) {
+			if (value) {
+				value->p = eq ? eq + 1 : amp;
+				value->len = amp - value->p;
+			}
+			return 1;
+		}
+		p = amp + 1;
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#define HTTP_MAX_HEADERS (32)	/* 单个请求最多保留的请求头数量 */
+
+/* 解析结果 */
+#define HTTP_AGAIN (0)			/* 数据不完整，等待更多数据 */
+#define HTTP_ERROR (-1)			/* 请求格式错误 */
+#define HTTP_TOO_MANY (-2)		/* 请求头数量超过 HTTP_MAX_HEADERS */
+
+/* 指向接收缓冲区的片段，不拷贝，也不以 '\0' 结尾 */
+typedef struct _http_slice
+{
+	const char *p;
+	int len;
+} http_slice;
+
+typedef struct _http_header
+{
+	http_slice name;
+	http_slice value;
+} http_header;
+
+typedef struct _http_request
+{
+	/* 解析器内部状态，可跨多次 recv 继续 */
+	int state;
+	int pos;					/* 已扫描到的位置 */
+	int mark;					/* 当前元素起点 */
+	int flags;					/* Connection 头等解析过程中的标记 */
+
+	/* 解析结果 */
+	http_slice method;
+	http_slice target;			/* 完整请求目标 */
+	http_slice path;			/* 目标中查询串之前的部分 */
+	http_slice query;			/* 最后一个 '?' 之后的 name=value 查询串 */
+	http_slice body;
+	int version;				/* 10 表示 HTTP/1.0，11 表示 HTTP/1.1 */
+	int keepalive;
+	int content_length;
+	int header_length;			/* 请求头（含空行）长度 */
+	int nheaders;
+	http_header headers[HTTP_MAX_HEADERS];
+} http_request;
+
+void http_reset(http_request *r);
+int http_parse(http_request *r, const char *buf, int len);
+const http_slice *http_header_get(const http_request *r, const char *name);
+int http_query_get(const http_request *r, const char *name, http_slice *value);
+int slice_case_equal(const http_slice *s, const char *str);
+
+#endif
@@ -12,16 +12,193 @@
 #include "json.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <float.h>
+#include <stdint.h>
 
-/* dump buffer define */
+/* dump buffer define, see json_buffer */
+typedef json_buffer BUFFER;
+
+/* hash index of object keys, open addressing with linear probing */
+typedef struct
+{
+	unsigned int epoch;						/* key_epoch when built */
+	int capacity;							/* power of 2 */
+	int used;								/* live and deleted slots */
+	json_t slot[];
+} INDEX;
+
+/* value of array and object, keep the tail and size so that appending is O(1) */
 typedef struct
 {
-	char* address;			  				/* buffer base address */
-	int size;				  				/* size of buffer */
-	int end;								/* end of buffer used */
-} BUFFER;
+	json_t child;							/* first child, must be the first member */
+	json_t tail;							/* last child */
+	int size;								/* number of children */
+	int dup;								/* duplicate keys found, the index is not used */
+	INDEX* index;							/* built lazily by keyed lookups on large objects */
+} LIST;
+
+/* vector width of the string scanners, the scalar loops handle the rest */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH							(32)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH							(16)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_WIDTH							(16)
+#endif
+#if defined(__aarch64__) && !defined(__SSE2__)
+#define SIMD_BITS							(4) /* bits per byte in the masks of simd_space */
+#else
+#define SIMD_BITS							(1)
+#endif
+
+/* characters that must be escaped on output */
+#define _escape(c)							((unsigned char)(c) < ' ' || (c) == '\"' || (c) == '\\')
+
+#ifdef SIMD_WIDTH
+/* a vector load at s does not cross into the next page, so reading past a terminator is safe */
+#define _page_safe(s)						(((uintptr_t)(s) & 4095) <= 4096 - SIMD_WIDTH)
+/* such reads are still outside the object for address sanitizer */
+#define SIMD_LOAD							__attribute__((no_sanitize_address))
+
+/**
+ *  \brief find the first byte of a vector that needs escaping or ends a string.
+ *  \param[in] *s: address of SIMD_WIDTH bytes
+ *  \param[in] nul: NUL also ends the scan
+ *  \return index of the byte, or SIMD_WIDTH if there is none
+ */
+SIMD_LOAD static inline int simd_special(const char* s, int nul)
+{
+#if defined(__AVX2__)
+	__m256i v = _mm256_loadu_si256((const __m256i*)s);
+	__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+	unsigned int bits;
+	if (nul) m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+	else m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v)); /* v < ' ' */
+	bits = (unsigned int)_mm256_movemask_epi8(m);
+	return bits ? __builtin_ctz(bits) : SIMD_WIDTH;
+#elif defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((const __m128i*)s);
+	__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	unsigned int bits;
+	if (nul) m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+	else m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v)); /* v < ' ' */
+	bits = (unsigned int)_mm_movemask_epi8(m);
+	return bits ? __builtin_ctz(bits) : SIMD_WIDTH;
+#else
+	uint8x16_t v = vld1q_u8((const uint8_t*)s);
+	uint8x16_t m = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\"')), vceqq_u8(v, vdupq_n_u8('\\')));
+	uint64_t bits;
+	if (nul) m = vorrq_u8(m, vceqzq_u8(v));
+	else m = vorrq_u8(m, vcltq_u8(v, vdupq_n_u8(' ')));
+	/* narrow to 4 bits per byte, there is no movemask */
+	bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+	return bits ? __builtin_ctzll(bits) >> 2 : SIMD_WIDTH;
+#endif
+}
+
+/**
+ *  \brief masks of white space and newlines in a vector, as skip() sees them.
+ *  \param[in] *s: address of SIMD_WIDTH bytes
+ *  \param[out] *nl: SIMD_BITS bits per byte, set for '\n'
+ *  \return SIMD_BITS bits per byte, set for bytes that are not white space
+ */
+SIMD_LOAD static inline uint64_t simd_space(const char* s, uint64_t* nl)
+{
+#if defined(__AVX2__)
+	__m256i v = _mm256_loadu_si256((const __m256i*)s);
+	__m256i space = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+		_mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(' ')), v)); /* 0 < v <= ' ' */
+	*nl = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+	return ~(uint64_t)(unsigned int)_mm256_movemask_epi8(space);
+#elif defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((const __m128i*)s);
+	__m128i space = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+		_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(' ')), v)); /* 0 < v <= ' ' */
+	*nl = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	return ~(uint64_t)(unsigned int)_mm_movemask_epi8(space);
+#else
+	uint8x16_t v = vld1q_u8((const uint8_t*)s);
+	uint8x16_t space = vandq_u8(vtstq_u8(v, v), vcleq_u8(v, vdupq_n_u8(' '))); /* 0 < v <= ' ' */
+	*nl = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(vceqq_u8(v, vdupq_n_u8('\n'))), 4)), 0);
+	return ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(space), 4)), 0);
+#endif
+}
+#endif
+
+/**
+ *  \brief length of the leading bytes that are printed without escaping.
+ *  \param[in] *s: address of string
+ *  \param[in] n: length of string
+ *  \return length
+ */
+static int span_plain(const char* s, int n)
+{
+	int i = 0;
+#ifdef SIMD_WIDTH
+	int k;
+	for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+	{
+		k = simd_special(s + i, 0);
+		if (k < SIMD_WIDTH) return i + k;
+	}
+#endif
+	while (i < n && !_escape(s[i])) i++;
+	return i;
+}
+
+/**
+ *  \brief length of the leading bytes of string text that are copied as they are, stops at quote or backslash.
+ *  \param[in] *s: address of text
+ *  \param[in] n: length of text
+ *  \return length
+ */
+static int span_string(const char* s, int n)
+{
+	int i = 0;
+#ifdef SIMD_WIDTH
+	int k;
+	for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+	{
+		k = simd_special(s + i, 1);
+		if (k < SIMD_WIDTH) break;
+	}
+#endif
+	while (i < n && s[i] != '\"' && s[i] != '\\') i++;
+	return i;
+}
+
+/**
+ *  \brief find the quote, backslash or NUL that ends a run of string text.
+ *  \param[in] *s: NUL terminated text
+ *  \return address of the character
+ */
+static const char* string_stop(const char* s)
+{
+#ifdef SIMD_WIDTH
+	int k;
+#endif
+	for (;;)
+	{
+#ifdef SIMD_WIDTH
+		if (_page_safe(s))
+		{
+			k = simd_special(s, 1);
+			if (k < SIMD_WIDTH) return s + k;
+			s += SIMD_WIDTH;
+			continue;
+		}
+#endif
+		if (!*s || *s == '\"' || *s == '\\') return s;
+		s++;
+	}
+}
+
+#define JSON_INDEX_MIN (16)					/* objects smaller than this are scanned linearly */
 
 /* number type define */
 typedef union
@@ -33,23 +210,25 @@ typedef union
 static malloc_t json_malloc = malloc;		/* memory allocation function */
 static free_t json_free = free;				/* memory release function */
 static realloc_t json_realloc = realloc;	/* memory reallocate function */
-static const char* error = NULL;			/* pointer to error message */
-static const char* lbegin = NULL;			/* beginning of line */
-static int eline = 0;						/* line of error message */
-static int etype = 0;						/* type of error message */
+static __thread json_context local_context;	/* context of json_loads and json_dumps, error state per thread */
+static unsigned int key_epoch = 0;			/* changed by json_set_key, invalidates all indexes */
+static JSON deleted_slot;					/* tombstone of index */
 
 /* predeclare these prototypes. */
-static const char* parse_value(const char* text, char* key, json_t* out);
+static const char* parse_value(json_context* ctx, const char* text, char* key, json_t* out);
 static int print_value(json_t json, BUFFER* buf, int depth, int format);
 
 /* set error message and type */
-#define _error(t)							(error=text,etype=(t))
+#define _error(t)							(ctx->error=text,ctx->etype=(t))
 #define _type(info)							(*(char*)(&(info)))
 #define _key(obj)							(*(char**)json_key_address(obj))
 #define _int(obj)							(*(int*)json_value_address(obj))
 #define _float(obj)							(*(double*)json_value_address(obj))
 #define _string(obj)						(*(char**)json_value_address(obj))
 #define _child(obj)							(*(json_t*)json_value_address(obj))
+#define _list(obj)							((LIST*)json_value_address(obj))
+#define _tail(obj)							(_list(obj)->tail)
+#define _size(obj)							(_list(obj)->size)
 
 static void* temp_realloc(void* block, size_t size)
 {
@@ -88,11 +267,11 @@ int json_set_hooks(malloc_t _malloc, free_t _free, realloc_t _realloc)
 	return 1;
 }
 
-static void json_report_error(void)
+static void json_report_error(json_context* ctx)
 {
-	const char* e = error;
+	const char* e = ctx->error;
 	if (!e) return;
-	printf("Parsing error, code %d line %d column %d, near [", etype, eline, (int)(error - lbegin));
+	printf("Parsing error, code %d line %d column %d, near [", ctx->etype, ctx->eline, (int)(ctx->error - ctx->lbegin));
 	if (*e)
 	{
 		do
@@ -111,10 +290,59 @@ static void json_report_error(void)
  */
 int json_error_info(int* line, int* column)
 {
-	if (!etype) return JSON_E_OK;
-	if (line) *line = eline;
-	if (column) *column = (int)(error - lbegin);
-	return etype;
+	return json_context_error_info(&local_context, line, column);
+}
+
+/**
+ *  \brief initialize context, for parsing and dumping on several threads at once.
+ *  \param[in] ctx: context
+ *  \param[in] _malloc: malloc fuction
+ *  \param[in] _free: free fuction
+ *  \param[in] _realloc: realloc fuction, all three NULL to use the functions set by json_set_hooks
+ *  \return 1 success or 0 fail
+ */
+int json_context_init(json_context* ctx, malloc_t _malloc, free_t _free, realloc_t _realloc)
+{
+	memset(ctx, 0, sizeof(json_context));
+	if (!_malloc && !_free && !_realloc)
+	{
+		_malloc = json_malloc;
+		_free = json_free;
+		_realloc = json_realloc;
+	}
+	if (!_malloc || !_free || !_realloc) return 0;
+	ctx->malloc_ = _malloc;
+	ctx->free_ = _free;
+	ctx->realloc_ = _realloc;
+	return 1;
+}
+
+/**
+ *  \brief for analysing failed parses of the context.
+ *  \param[in] ctx: context
+ *  \param[out] *line: error line
+ *  \param[out] *column: error column
+ *  \return error type
+ */
+int json_context_error_info(json_context* ctx, int* line, int* column)
+{
+	if (!ctx->etype) return JSON_E_OK;
+	if (line) *line = ctx->eline;
+	if (column) *column = (int)(ctx->error - ctx->lbegin);
+	return ctx->etype;
+}
+
+/**
+ *  \brief context of json_loads and json_dumps on this thread, with the functions set by json_set_hooks.
+ *  \return context
+ */
+static json_context* default_context(void)
+{
+	json_context* ctx = &local_context;
+	ctx->malloc_ = json_malloc;
+	ctx->free_ = json_free;
+	ctx->realloc_ = json_realloc;
+	return ctx;
 }
 
 /**
@@ -175,11 +403,13 @@ static int expansion(BUFFER *buf, int needed)
 {
 	char* address;
 	int size;
-	if (!buf || !buf->address) return 0;
+	if (!buf) return 0;
+	if (buf->end + needed <= buf->size) return 1;
+	if (buf->flush) return needed > 0 && buf->flush(buf, needed) && buf->end + needed <= buf->size; /* hand over to the sink */
 	needed += buf->end;
 	if (needed <= buf->size) return 1; /* there is still enough space in the current buf */
 	size = pow2gt(needed);
-	address = (char*)json_realloc(buf->address, size);
+	address = (char*)(buf->realloc_ ? buf->realloc_ : json_realloc)(buf->address, size);
 	if (!address) return 0;
 	buf->size = size;
 	buf->address = address;
@@ -222,8 +452,8 @@ static unsigned int get_hex4(const char* text)
 }
 
 /**
- *  \brief convert utf16 to utf8.
- *  \param[in] **in: address of input char pointer
+ *  \brief convert utf16 to utf8, both pointers are advanced only when the escape is valid.
+ *  \param[in] **in: address of input char pointer, at 'u'
  *  \param[in] **out: address of output char pointer
  *  \return none
  */
@@ -257,22 +487,45 @@ static void json_utf(const char** in, char** out)
 	case 1: *--p2 = (uc | mask_first_byte[len]);
 	}
 	p2 += len;
+	*in = p1; /* at the last hex digit */
+	*out = p2;
 }
 
 /**
  *  \brief skip meaningless characters.
+ *  \param[in] ctx: context
  *  \param[in] *in: address of character
  *  \return the address of the next meaningful character
  */
-static const char* skip(const char* in)
+static const char* skip(json_context* ctx, const char* in)
 {
+#ifdef SIMD_WIDTH
+	uint64_t stop, nl;
+	int k;
+#endif
 	while (in && *in && (unsigned char)(*in) <= ' ')
 	{
+#ifdef SIMD_WIDTH
+		/* indentation of formatted text, a vector at a time */
+		if (_page_safe(in))
+		{
+			stop = simd_space(in, &nl);
+			k = stop ? __builtin_ctzll(stop) / SIMD_BITS : SIMD_WIDTH;
+			if (k < SIMD_WIDTH) nl &= ((uint64_t)1 << (k * SIMD_BITS)) - 1;
+			if (nl)
+			{
+				ctx->eline += __builtin_popcountll(nl) / SIMD_BITS;
+				ctx->lbegin = in + (63 - __builtin_clzll(nl)) / SIMD_BITS;
+			}
+			in += k;
+			continue;
+		}
+#endif
 		/* when a newline character is encountered, record the current parsing line */
 		if (*in == '\n')
 		{
-			eline++;
-			lbegin = in;
+			ctx->eline++;
+			ctx->lbegin = in;
 		}
 		in++;
 	}
@@ -391,11 +644,12 @@ json_t json_value_object(json_t json)
 
 /**
  *  \brief create new json item.
+ *  \param[in] _malloc: malloc function
  *  \param[in] info: information of json
  *  \param[in] *key: json key, create json for object with key, otherwise create json for array
  *  \return newly created json handle
  */
-static json_t json_new(int info, char* key)
+static json_t json_new(malloc_t _malloc, int info, char* key)
 {
 	json_t json;
 	int size = sizeof(JSON); /* original size */
@@ -407,10 +661,10 @@ static json_t json_new(int info, char* key)
 	/* append the size of the value member */
 	if (_type(info) == JSON_TYPE_NUMBER) size += sizeof(number);
 	else if (_type(info) == JSON_TYPE_STRING) size += sizeof(char*);
-	else if (_type(info) == JSON_TYPE_ARRAY || _type(info) == JSON_TYPE_OBJECT) size += sizeof(json_t);
+	else if (_type(info) == JSON_TYPE_ARRAY || _type(info) == JSON_TYPE_OBJECT) size += sizeof(LIST);
 
 	/* allocate json space and initialize */
-	json = (json_t)json_malloc(size);
+	json = (json_t)_malloc(size);
 	if (json)
 	{
 		memset(json, 0, size);
@@ -421,12 +675,169 @@ static json_t json_new(int info, char* key)
 	return json;
 }
 
+/**
+ *  \brief case-insensitive hash of key, consistent with string_case_compare.
+ *  \param[in] *key: key
+ *  \return hash value
+ */
+static unsigned int key_hash(const char* key)
+{
+	unsigned int h = 2166136261u;
+	while (*key) { h ^= (unsigned char)tolower((unsigned char)*key++); h *= 16777619u; }
+	return h;
+}
+
+/**
+ *  \brief release the index of array or object.
+ *  \param[in] json: json handle
+ *  \return none
+ */
+static void index_drop(json_t json)
+{
+	LIST* l = _list(json);
+	if (l->index) { json_free(l->index); l->index = NULL; }
+}
+
+/**
+ *  \brief release the index of json if a key was renamed since it was built.
+ *  \param[in] json: json handle
+ *  \return none
+ */
+static void index_check(json_t json)
+{
+	LIST* l = _list(json);
+	if (l->index && l->index->epoch != __atomic_load_n(&key_epoch, __ATOMIC_RELAXED)) index_drop(json);
+}
+
+/**
+ *  \brief find the slot of key, or the empty slot to insert it.
+ *  \param[in] ix: index
+ *  \param[in] *key: key
+ *  \return address of slot
+ */
+static json_t* index_slot(INDEX* ix, const char* key)
+{
+	unsigned int mask = ix->capacity - 1, i = key_hash(key) & mask;
+	json_t* tomb = NULL;
+	while (ix->slot[i])
+	{
+		if (ix->slot[i] == &deleted_slot) { if (!tomb) tomb = &ix->slot[i]; }
+		else if (!string_case_compare(_key(ix->slot[i]), key)) return &ix->slot[i];
+		i = (i + 1) & mask;
+	}
+	return tomb ? tomb : &ix->slot[i];
+}
+
+/**
+ *  \brief add a child to the index of json, drop the index when the key is duplicate or the table is full.
+ *  \param[in] json: json handle
+ *  \param[in] item: child to add
+ *  \return none
+ */
+static void index_add(json_t json, json_t item)
+{
+	LIST* l = _list(json);
+	json_t* s;
+	index_check(json);
+	if (!l->index) return;
+	s = index_slot(l->index, _key(item));
+	if (*s && *s != &deleted_slot) { l->dup = 1; index_drop(json); return; }
+	if (!*s) l->index->used++;
+	*s = item;
+	/* keep load factor below 3/4, rebuilt larger by the next lookup */
+	if (l->index->used * 4 >= l->index->capacity * 3) index_drop(json);
+}
+
+/**
+ *  \brief remove a child from the index of json.
+ *  \param[in] json: json handle
+ *  \param[in] item: child to remove
+ *  \return none
+ */
+static void index_remove(json_t json, json_t item)
+{
+	LIST* l = _list(json);
+	json_t* s;
+	l->dup = 0; /* the duplicate may be the one removed, try again on next lookup */
+	index_check(json);
+	if (!l->index) return;
+	s = index_slot(l->index, _key(item));
+	if (*s == item) *s = &deleted_slot;
+}
+
+/**
+ *  \brief build the index of object.
+ *  \param[in] json: json handle
+ *  \return 1 success or 0 fail
+ */
+static int index_build(json_t json)
+{
+	LIST* l = _list(json);
+	int capacity = 32;
+	json_t c;
+	while (capacity < l->size * 2) capacity <<= 1;
+	l->index = (INDEX*)json_malloc(sizeof(INDEX) + capacity * sizeof(json_t));
+	if (!l->index) return 0;
+	memset(l->index, 0, sizeof(INDEX) + capacity * sizeof(json_t));
+	l->index->capacity = capacity;
+	l->index->epoch = __atomic_load_n(&key_epoch, __ATOMIC_RELAXED);
+	for (c = l->child; c && l->index; c = c->next) index_add(json, c);
+	return l->index ? 1 : 0;
+}
+
+/**
+ *  \brief look up the first child with key through the index.
+ *  \param[in] json: json handle, object type
+ *  \param[in] *key: key
+ *  \param[out] *found: the matched child, NULL if not found
+ *  \return 1 the index was used, or 0 the caller should scan the list
+ */
+static int index_lookup(json_t json, const char* key, json_t* found)
+{
+	LIST* l = _list(json);
+	json_t s;
+	if (l->dup) return 0;
+	index_check(json);
+	if (!l->index && !index_build(json)) return 0;
+	s = *index_slot(l->index, key);
+	*found = (s == &deleted_slot) ? NULL : s;
+	return 1;
+}
+
+/**
+ *  \brief append item to the end of the child list of array or object.
+ *  \param[in] json: json handle
+ *  \param[in] item: item to append
+ *  \return none
+ */
+static void json_append(json_t json, json_t item)
+{
+	LIST* l = _list(json);
+	item->next = NULL;
+	if (l->tail) l->tail->next = item;
+	else l->child = item;
+	l->tail = item;
+	l->size++;
+	index_add(json, item);
+}
+
 /**
  *  \brief delete the json entity and its sub-entities.
  *  \param[in] json: json handle
  *  \return none
  */
 void json_delete(json_t json)
+{
+	json_context_delete(default_context(), json);
+}
+
+/**
+ *  \brief delete json tree loaded by the context, and its sub-items.
+ *  \param[in] ctx: context
+ *  \param[in] json: json handle
+ *  \return none
+ */
+void json_context_delete(json_context* ctx, json_t json)
 {
 	json_t next;
 
@@ -437,86 +848,160 @@ void json_delete(json_t json)
 		/* delete recursively */
 		if (_type(json->info) == JSON_TYPE_ARRAY || _type(json->info) == JSON_TYPE_OBJECT)
 		{
-			json_delete(_child(json)); /* recursively delete child objects */
+			json_context_delete(ctx, _child(json)); /* recursively delete child objects */
+			index_drop(json); /* index always comes from the hooks of json_set_hooks */
 		}
 		if (_type(json->info) == JSON_TYPE_STRING && _string(json))
 		{
-			json_free(_string(json)); /* delete string value */
+			ctx->free_(_string(json)); /* delete string value */
 		}
 		if (json->info & JSON_WITH_KEY && _key(json))
 		{
-			json_free(_key(json)); /* delete key */
+			ctx->free_(_key(json)); /* delete key */
 		}
 
-		json_free(json); /* delete self */
+		ctx->free_(json); /* delete self */
 
 		json = next;
 	}
 }
 
+#define SCAN_DIGITS							(768) /* significant digits that decide the rounding of any double */
+
 /**
- *  \brief parse the input text to generate numbers, and fill the results into json.
+ *  \brief convert decimal significand and exponent to double, correctly rounded.
  *  \param[in] *text: number text
- *  \param[in] *key: address of key
- *  \param[out] *out: the address used to receive the parsed json object
- *  \return the new address of the transformed text
+ *  \param[in] *end: end of the integer and fractional parts
+ *  \param[in] exp10: exponent part
+ *  \return value without sign
  */
-static const char* parse_number(const char* text, char* key, json_t* out)
+static double scan_slow(const char* text, const char* end, int exp10)
 {
-	json_t n;
-	double num = 0;
-	int sign = 1, scale = 0, e_sign = 1, e_scale = 0;
-	int isint = 1; // int, accurate parsing of integer parts
+	char digits[SCAN_DIGITS + 16], *p = digits;
+	int n = 0, frac = 0, sticky = 0;
+
+	/* the digits with the decimal point removed, "<digits>e<exp>" does not depend on the locale */
+	for (; text < end; text++)
+	{
+		if (*text == '.') { frac = 1; continue; }
+		if (n == 0 && *text == '0') { exp10 -= frac; continue; }
+		if (n < SCAN_DIGITS) { digits[n++] = *text; exp10 -= frac; }
+		else { exp10 += !frac; sticky |= *text != '0'; }
+	}
+	if (n == 0) return 0.0;
+	if (sticky) { digits[n++] = '1'; exp10--; } /* digits beyond only matter for which side of the halfway point */
+	p += n;
+	*p++ = 'e';
+	p += sprintf(p, "%d", exp10);
+	return strtod(digits, NULL);
+}
+
+/**
+ *  \brief scan number text.
+ *  \param[in,out] **in: address of number text, moved to the end of the number, or to the error
+ *  \param[out] *out: value
+ *  \return 1 integer, 0 float, or -1 fail
+ */
+static int scan_number(const char** in, double* out)
+{
+	static const double exact_pow[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char* text = *in;
+	const char* begin;
+	const char* first;
+	uint64_t m = 0; // significant digits, exact up to 19 digits
+	int digits = 0, scale = 0, e_sign = 1, e_scale = 0, negative = 0;
+	int isint = 1;
+	double num;
 
 	if (*text == '-') /* sign part */
 	{
-		sign = -1;
+		negative = 1;
 		text++;
-		if (!(*text >= '0' && *text <= '9')) { _error(JSON_E_NUMBER); return NULL; }
+		if (!(*text >= '0' && *text <= '9')) { *in = text; return -1; }
 	}
+	begin = text;
 	while (*text == '0') text++; /* skip zero */
-	if (*text >= '1' && *text <= '9') /* integer part */
-	{
-		do
-		{
-			num = (num * 10.0) + (*text++ - '0'); /* carry addition */
-		} while (*text >= '0' && *text <= '9');
-	}
+	first = text;
+	while (*text >= '0' && *text <= '9') m = m * 10 + (*text++ - '0'); /* integer part, wraps beyond 19 digits */
+	digits = (int)(text - first);
 	if (*text == '.') /* fractional part */
 	{
 		text++;
-		if (!(*text >= '0' && *text <= '9')) { _error(JSON_E_NUMBER); return NULL; }
-		do
-		{
-			num = (num * 10.0) + (*text++ - '0');
-			scale--;
-		} while (*text >= '0' && *text <= '9');
+		if (!(*text >= '0' && *text <= '9')) { *in = text; return -1; }
+		first = text;
+		if (digits == 0) while (*text == '0') text++; /* leading zeros are not significant */
+		scale = (int)(first - text);
+		first = text;
+		while (*text >= '0' && *text <= '9') m = m * 10 + (*text++ - '0');
+		digits += (int)(text - first);
+		scale -= (int)(text - first);
 		isint = 0;
 	}
 	if (*text == 'e' || *text == 'E') /* exponent part */
 	{
-		text++;
+		const char* end = text++;
 		if (*text == '+') text++;
 		else if (*text == '-') /* with sign */
 		{
 			e_sign = -1;
 			text++;
 		}
-		if (!(*text >= '0' && *text <= '9')) { _error(JSON_E_NUMBER); return NULL; }
+		if (!(*text >= '0' && *text <= '9')) { *in = text; return -1; }
 		while (*text >= '0' && *text <= '9') /* num */
 		{
-			e_scale = (e_scale * 10) + (*text++ - '0');
+			if (e_scale < 100000000) e_scale = (e_scale * 10) + (*text - '0');
+			text++;
 		}
 		isint = 0;
+		*in = text;
+		text = end;
+	}
+	else *in = text;
+
+	/* integers of up to 19 digits are exact, the common case of counters and timestamps */
+	if (isint && digits <= 19)
+	{
+		num = (double)m;
+		*out = negative ? -num : num;
+		return m <= (uint64_t)INT_MAX + negative;
+	}
+	/* both the significand and the power of ten are exact, a single rounding */
+	scale += e_sign * e_scale;
+	if (digits <= 19 && m <= (1ULL << 53) && scale >= -22 && scale <= 22 && FLT_EVAL_METHOD == 0)
+	{
+		num = scale < 0 ? (double)m / exact_pow[-scale] : (double)m * exact_pow[scale];
 	}
+	else num = scan_slow(begin, text, e_sign * e_scale);
+	*out = negative ? -num : num;
+
+	return 0;
+}
+
+/**
+ *  \brief parse the input text to generate numbers, and fill the results into json.
+ *  \param[in] ctx: context
+ *  \param[in] *text: number text
+ *  \param[in] *key: address of key
+ *  \param[out] *out: the address used to receive the parsed json object
+ *  \return the new address of the transformed text
+ */
+static const char* parse_number(json_context* ctx, const char* text, char* key, json_t* out)
+{
+	json_t n;
+	double num;
+	int isint = scan_number(&text, &num);
+
+	if (isint < 0) { _error(JSON_E_NUMBER); return NULL; }
 
 	/* create json */
-	n = json_new(JSON_TYPE_NUMBER, key);
+	n = json_new(ctx->malloc_, JSON_TYPE_NUMBER, key);
 	if (!n) { _error(JSON_E_MEMORY); return NULL; }
 	*out = n;
 
-	num = (double)sign * num * pow(10.0, (scale + e_scale * e_sign));
-	if (isint && INT_MIN <= num && num <= INT_MAX)
+	if (isint)
 	{
 		n->info |= JSON_NUMBER_INT;
 		_int(n) = (int)num;
@@ -528,13 +1013,15 @@ static const char* parse_number(const char* text, char* key, json_t* out)
 
 /**
  *  \brief parse the input text to buffer, and fill the results into buf.
+ *  \param[in] ctx: context
  *  \param[in] *text: number text
  *  \param[out] **buf: the address used to receive the parsed string pointer
  *  \return the new address of the transformed text
  */
-static const char* parse_string_buffer(const char* text, char** buf)
+static const char* parse_string_buffer(json_context* ctx, const char* text, char** buf)
 {
 	const char* p1 = text + 1;
+	const char* q;
 	char* p2;
 	char* out;
 	int len = 0;
@@ -545,38 +1032,43 @@ static const char* parse_string_buffer(const char* text, char** buf)
 	if (*text != '\"') { _error(JSON_E_GRAMMAR); return NULL; }
 
 	/* get length */
-	while (*p1 && *p1 != '\"')
+	for (;;)
 	{
-		if (*p1++ == '\\') p1++; /* skip escaped quotes. */
+		q = string_stop(p1);
+		len += (int)(q - p1);
+		p1 = q;
+		if (*p1 != '\\') break;
+		p1++;
+		if (*p1) p1++; /* skip escaped quotes. */
 		len++;
 	}
 
-	out = (char*)json_malloc(len + 1);
+	out = (char*)ctx->malloc_(len + 1);
 	if (!out) { _error(JSON_E_MEMORY); return NULL; }
 
 	/* copy text to new space */
 	p1 = text + 1;
 	p2 = out;
-	while (*p1 && *p1 != '\"')
+	for (;;)
 	{
-		/* normal character */
-		if (*p1 != '\\')
-		{
-			*p2++ = *p1++;
-		}
+		/* normal characters, copied a run at a time */
+		q = string_stop(p1);
+		memcpy(p2, p1, q - p1);
+		p2 += q - p1;
+		p1 = q;
+		if (*p1 != '\\') break;
+
 		/* escape character */
-		else
-		{
-			p1++;
-			if (*p1 == 'b') { *p2++ = '\b'; }
-			else if (*p1 == 'f') { *p2++ = '\f'; }
-			else if (*p1 == 'n') { *p2++ = '\n'; }
-			else if (*p1 == 'r') { *p2++ = '\r'; }
-			else if (*p1 == 't') { *p2++ = '\t'; }
-			else if (*p1 == 'u') { json_utf(&p1, &p2); }
-			else { *p2++ = *p1; }
-			p1++;
-		}
+		p1++;
+		if (!*p1) break;
+		if (*p1 == 'b') { *p2++ = '\b'; }
+		else if (*p1 == 'f') { *p2++ = '\f'; }
+		else if (*p1 == 'n') { *p2++ = '\n'; }
+		else if (*p1 == 'r') { *p2++ = '\r'; }
+		else if (*p1 == 't') { *p2++ = '\t'; }
+		else if (*p1 == 'u') { json_utf(&p1, &p2); }
+		else { *p2++ = *p1; }
+		p1++;
 	}
 
 	*p2 = 0;
@@ -589,22 +1081,23 @@ static const char* parse_string_buffer(const char* text, char** buf)
 
 /**
  *  \brief parse the input text and fill the result into json.
+ *  \param[in] ctx: context
  *  \param[in] *text: string text
  *  \param[in] *key: address of key
  *  \param[out] *out: the address used to receive the parsed json object
  *  \return the new address of the transformed text
  */
-static const char* parse_string(const char* text, char* key, json_t* out)
+static const char* parse_string(json_context* ctx, const char* text, char* key, json_t* out)
 {
 	json_t n;
 	const char* t;
 	char* buf;
 
-	t = parse_string_buffer(text, &buf);
+	t = parse_string_buffer(ctx, text, &buf);
 	if (!t) return NULL;
 
-	n = json_new(JSON_TYPE_STRING, key);
-	if (!n) { _error(JSON_E_MEMORY); json_free(buf); return NULL; }
+	n = json_new(ctx->malloc_, JSON_TYPE_STRING, key);
+	if (!n) { _error(JSON_E_MEMORY); ctx->free_(buf); return NULL; }
 	*out = n;
 
 	_string(n) = buf;
@@ -614,12 +1107,13 @@ static const char* parse_string(const char* text, char* key, json_t* out)
 
 /**
  *  \brief parse array.
+ *  \param[in] ctx: context
  *  \param[in] *text: text
  *  \param[in] *key: address of key
  *  \param[out] *out: the address used to receive the parsed json object
  *  \return address of the end of the parsed text, or NULL fail
  */
-static const char* parse_array(const char* text, char* key, json_t* out)
+static const char* parse_array(json_context* ctx, const char* text, char* key, json_t* out)
 {
 	json_t n, prev = NULL, child = NULL;
 
@@ -627,26 +1121,25 @@ static const char* parse_array(const char* text, char* key, json_t* out)
 	if (*text != '[') { _error(JSON_E_INVALID); return NULL; } 
 
 	/* create json object */
-	n = json_new(JSON_TYPE_ARRAY, key);
+	n = json_new(ctx->malloc_, JSON_TYPE_ARRAY, key);
 	if (!n) { _error(JSON_E_MEMORY); return NULL; }
 	if (key) _key(n) = NULL;
 	*out = n; /* output json object */
 
 	/* empty array. */
-	text = skip(text + 1);
-	if (*text == ']') return text + 1; 
+	text = skip(ctx, text + 1);
+	if (*text == ']') { if (key) _key(n) = key; return text + 1; }
 
 	/* parse each member of the array */
 	do {
 		if (prev) text++; /* skip ',' */
 
 		/* parse value */
-		text = skip(parse_value(skip(text), NULL, &child));
+		text = skip(ctx, parse_value(ctx, skip(ctx, text), NULL, &child));
 		if (!text) goto FAIL;
 
 		/* link */
-		if (prev) prev->next = child;
-		else _child(n) = child;
+		json_append(n, child);
 		prev = child;
 	} while (*text == ',');
 
@@ -657,19 +1150,20 @@ static const char* parse_array(const char* text, char* key, json_t* out)
 	return text + 1;
 
 FAIL:
-	json_delete(n);
+	json_context_delete(ctx, n);
 	*out = NULL;
 	return NULL;
 }
 
 /**
  *  \brief parse object.
+ *  \param[in] ctx: context
  *  \param[in] *text: text
  *  \param[in] *key: address of key
  *  \param[out] *out: the address used to receive the parsed json object
  *  \return address of the end of the parsed text, or NULL fail
  */
-static const char* parse_object(const char* text, char* key, json_t* out)
+static const char* parse_object(json_context* ctx, const char* text, char* key, json_t* out)
 {
 	json_t n, prev = NULL, child = NULL;
 	char* k = NULL;
@@ -678,33 +1172,32 @@ static const char* parse_object(const char* text, char* key, json_t* out)
 	if (*text != '{') { _error(JSON_E_INVALID); return NULL; }
 
 	/* create json object */
-	n = json_new(JSON_TYPE_OBJECT, key);
+	n = json_new(ctx->malloc_, JSON_TYPE_OBJECT, key);
 	if (!n) { _error(JSON_E_MEMORY); return NULL; }
 	if (key) _key(n) = NULL;
 	*out = n; /* output json object */
 
 	/* empty object */
-	text = skip(text + 1);
-	if (*text == '}') return text + 1;
+	text = skip(ctx, text + 1);
+	if (*text == '}') { if (key) _key(n) = key; return text + 1; }
 
 	/* parse each json object */
 	do {
 		if (prev) text++; /* skip ',' */
 
 		/* parse key */
-		text = skip(parse_string_buffer(skip(text), &k));
+		text = skip(ctx, parse_string_buffer(ctx, skip(ctx, text), &k));
 		if (!text) goto FAIL;
 
 		/* parse indicator ':' */
 		if (*text != ':') { _error(JSON_E_INDICATOR); goto FAIL; }
 
 		/* parse value */
-		text = skip(parse_value(skip(text + 1), k, &child));
+		text = skip(ctx, parse_value(ctx, skip(ctx, text + 1), k, &child));
 		if (!text) goto FAIL;
 
 		/* link */
-		if (prev) prev->next = child;
-		else _child(n) = child;
+		json_append(n, child);
 		prev = child;
 	} while (*text == ',');
 
@@ -715,180 +1208,489 @@ static const char* parse_object(const char* text, char* key, json_t* out)
 	return text + 1;
 
 FAIL:
-	if (k) json_free(k);
-	json_delete(n);
+	if (k) ctx->free_(k);
+	json_context_delete(ctx, n);
 	*out = NULL;
 	return NULL;
 }
 
 /**
  *  \brief parser core, parse text.
+ *  \param[in] ctx: context
  *  \param[in] *text: text
  *  \param[in] *key: address of key
  *  \param[out] *out: the address used to receive the parsed json object
  *  \return address of the end of the parsed text, or NULL fail
  */
-static const char* parse_value(const char* text, char* key, json_t* out)
+static const char* parse_value(json_context* ctx, const char* text, char* key, json_t* out)
 {
 	*out = NULL;
 	if (!strncmp(text, "null", 4))
 	{
-		*out = json_new(JSON_TYPE_NULL, key);
+		*out = json_new(ctx->malloc_, JSON_TYPE_NULL, key);
 		if (!*out) { _error(JSON_E_MEMORY); return NULL; }
 		return text + 4;
 	}
 	if (!strncmp(text, "false", 5))
 	{
-		*out = json_new(JSON_TYPE_BOOL, key);
+		*out = json_new(ctx->malloc_, JSON_TYPE_BOOL, key);
 		if (!*out) { _error(JSON_E_MEMORY); return NULL; }
 		return text + 5;
 	}
 	if (!strncmp(text, "true", 4))
 	{
-		*out = json_new(JSON_TYPE_BOOL | JSON_VALUE_B_TRUE, key);
+		*out = json_new(ctx->malloc_, JSON_TYPE_BOOL | JSON_VALUE_B_TRUE, key);
 		if (!*out) { _error(JSON_E_MEMORY); return NULL; }
 		return text + 4;
 	}
-	if (*text == '-' || (*text >= '0' && *text <= '9')) return parse_number(text, key, out);
-	if (*text == '\"') return parse_string(text, key, out);
-	if (*text == '[') return parse_array(text, key, out);
-	if (*text == '{') return parse_object(text, key, out);
+	if (*text == '-' || (*text >= '0' && *text <= '9')) return parse_number(ctx, text, key, out);
+	if (*text == '\"') return parse_string(ctx, text, key, out);
+	if (*text == '[') return parse_array(ctx, text, key, out);
+	if (*text == '{') return parse_object(ctx, text, key, out);
 
 	_error(JSON_E_INVALID);
 
 	return NULL;
 }
 
+/* two digit decimal strings of 00 to 99 */
+static const char digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
 /**
- *  \brief convert numbers in json to text and append to buf.
- *  \param[in] json: json handle
+ *  \brief convert integer to text and append to buf.
+ *  \param[in] num: number
  *  \param[in] buf: buf handle
  *  \return 1 success or 0 fail
  */
-static int print_number(json_t json, BUFFER* buf)
+static int print_int(int num, BUFFER* buf)
 {
-	double f;
-	int len = 0;
+	char tmp[12], *p = tmp + sizeof(tmp);
+	unsigned int u = num < 0 ? 0u - (unsigned int)num : (unsigned int)num;
+	int len;
 
-	/* the number type is an integer */
-	if (json->info & JSON_NUMBER_INT)
-	{
-		if (!buf_append(20)) return 0; // 64-bit integer takes up to 19 numeric characters, and sign
-		len = sprintf(buf_end(), "%d", _int(json));
-		buf->end += len;
-	}
-	/* the type of number is a floating point type */
-	else
+	if (!buf_append(12)) return 0; // 32-bit integer takes up to 10 numeric characters, and sign
+	/* two digits at a time from the lowest */
+	while (u >= 100)
 	{
-		if (!buf_append(64)) return 0;
-		f = _float(json);
-		/* use full transformation within bounded space */
-		if (fabs(floor(f) - f) <= DBL_EPSILON && fabs(f) < 1.0e60) len = sprintf(buf_end(), "%.1lf", f);
-		/* use exponential form conversion beyond the limited range */
-		else if (fabs(f) < 1.0e-6 || fabs(f) > 1.0e9) len = sprintf(buf_end(), "%e", f);
-		/* default conversion */
-		else
-		{
-			len = sprintf(buf_end(), "%lf", f);
-			/* remove the invalid 0 in the decimal part */
-			while (len > 0 && buf_end()[len-1] == '0' && buf_end()[len-2] != '.') len--;
-		}
-		buf->end += len;
+		p -= 2;
+		memcpy(p, &digit_pairs[(u % 100) * 2], 2);
+		u /= 100;
 	}
+	if (u >= 10) { p -= 2; memcpy(p, &digit_pairs[u * 2], 2); }
+	else *--p = '0' + u;
+	if (num < 0) *--p = '-';
+	len = (int)(tmp + sizeof(tmp) - p);
+	memcpy(buf_end(), p, len);
+	buf->end += len;
 
 	return 1;
 }
 
+/* floating point number with 64-bit significand, value = f * 2^e */
+typedef struct
+{
+	uint64_t f;
+	int e;
+} DIYFP;
+
+/* normalized 10^k for k = -348, -340, ... 340 */
+static const uint64_t cached_powers_f[] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+	0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+	0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+	0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+	0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+	0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+	0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+	0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+	0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+	0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+	0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+	0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+	0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+	0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+	0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const short cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066,
+};
+
 /**
- *  \brief store c string conversion to buf.
- *  \param[in] *str: address of string
- *  \param[in] buf: buf handle
- *  \return 1 success or 0 fail
+ *  \brief multiply two numbers, the 128-bit product rounded to the upper 64 bits.
+ *  \param[in] x: number
+ *  \param[in] y: number
+ *  \return product
  */
-static int print_string_buffer(const char* str, BUFFER* buf)
+static DIYFP diyfp_mul(DIYFP x, DIYFP y)
+{
+	uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFF, c = y.f >> 32, d = y.f & 0xFFFFFFFF;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF) + (1ULL << 31);
+	DIYFP r;
+	r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+	r.e = x.e + y.e + 64;
+	return r;
+}
+
+/* 10^0 ... 10^19 */
+static const uint64_t ten_pow[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/**
+ *  \brief move the last digit down towards the value and check the result is provably the closest shortest digits.
+ *  \param[in] *digits: digits generated
+ *  \param[in] len: number of digits
+ *  \param[in] too_high_w: distance from the value to the upper bound of the unsafe interval
+ *  \param[in] unsafe: width of the unsafe interval, the rounding interval widened by the error
+ *  \param[in] rest: distance from the digits to the upper bound of the unsafe interval
+ *  \param[in] ten_kappa: unit of the last digit
+ *  \param[in] unit: error of the scaled numbers
+ *  \return 1 the digits are correct, or 0 the error is too large to decide
+ */
+static int grisu_weed(char* digits, int len, uint64_t too_high_w, uint64_t unsafe, uint64_t rest, uint64_t ten_kappa, uint64_t unit)
 {
-	const char* p;
-	int len = 0, escape = 0;
+	uint64_t small = too_high_w - unit, big = too_high_w + unit;
 
-	/* empty string */
-	if (!str)
+	/* the value lies somewhere in (too_high - big, too_high - small), get as close as possible to the far end */
+	while (rest < small && unsafe - rest >= ten_kappa &&
+		(rest + ten_kappa < small || small - rest >= rest + ten_kappa - small))
 	{
-		if (!buf_append(2)) return 0;
-		buf_putc('\"');
-		buf_putc('\"');
-		return 1;
+		digits[len - 1]--;
+		rest += ten_kappa;
 	}
+	/* the near end would have moved one more, the closest digits are unknown */
+	if (rest < big && unsafe - rest >= ten_kappa &&
+		(rest + ten_kappa < big || big - rest > rest + ten_kappa - big)) return 0;
+	/* the digits must be inside the interval even if the error is at its worst */
+	return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
 
-	/* get length */
-	p = str;
-	while (*p)
+/**
+ *  \brief shortest digits of a positive finite double that read back to the same value (Grisu3).
+ *  \param[in] v: number
+ *  \param[out] *digits: decimal digits, 17 at most
+ *  \param[out] *k: decimal exponent, v = digits * 10^k
+ *  \return number of digits, or 0 when the result can not be proven shortest (about 0.5% of values)
+ */
+static int grisu3(double v, char* digits, int* k)
+{
+	uint64_t bits, unsafe, too_high_w, p2, rest, unit = 1;
+	uint32_t p1;
+	DIYFP w, mp, mm, c, one;
+	int index, kappa, len = 0, shift;
+	double dk;
+
+	memcpy(&bits, &v, sizeof(bits));
+	w.f = bits & 0x000FFFFFFFFFFFFFULL;
+	w.e = (int)(bits >> 52);
+	if (w.e) { w.f |= 0x0010000000000000ULL; w.e -= 1075; }
+	else w.e = -1074;
+
+	/* boundaries of the rounding interval, with the same exponent */
+	mp.f = (w.f << 1) + 1;
+	mp.e = w.e - 1;
+	shift = __builtin_clzll(mp.f);
+	mp.f <<= shift;
+	mp.e -= shift;
+	if (w.f == 0x0010000000000000ULL) { mm.f = (w.f << 2) - 1; mm.e = w.e - 2; }
+	else { mm.f = (w.f << 1) - 1; mm.e = w.e - 1; }
+	mm.f <<= mm.e - mp.e;
+	mm.e = mp.e;
+	shift = __builtin_clzll(w.f);
+	w.f <<= shift;
+	w.e -= shift;
+
+	/* scale by a cached power of ten into a range where the integer part fits 32 bits */
+	dk = (-61 - mp.e) * 0.30102999566398114 + 347;
+	index = (int)dk;
+	if (dk - index > 0.0) index++;
+	index = (index >> 3) + 1;
+	*k = -(-348 + (index << 3));
+	c.f = cached_powers_f[index];
+	c.e = cached_powers_e[index];
+	w = diyfp_mul(w, c);
+	mp = diyfp_mul(mp, c);
+	mm = diyfp_mul(mm, c);
+
+	/* each scaled number is off by less than one unit, widen the interval by the error */
+	mm.f -= unit;
+	mp.f += unit;
+	unsafe = mp.f - mm.f;
+	too_high_w = mp.f - w.f;
+
+	/* generate digits of the upper bound until they are inside the unsafe interval */
+	one.e = mp.e;
+	one.f = 1ULL << -one.e;
+	p1 = (uint32_t)(mp.f >> -one.e);
+	p2 = mp.f & (one.f - 1);
+	for (kappa = 1; kappa < 10 && p1 >= ten_pow[kappa]; kappa++);
+	while (kappa > 0)
 	{
-		len++;
-		if (*p == '\"' || *p == '\\' || *p == '\b' || *p == '\f' || *p == '\n' || *p == '\r' || *p == '\t') /* escape character */
+		uint32_t d = p1 / (uint32_t)ten_pow[kappa - 1];
+		p1 %= (uint32_t)ten_pow[kappa - 1];
+		if (d || len) digits[len++] = (char)('0' + d);
+		kappa--;
+		rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest < unsafe)
 		{
-			escape = 1;
-			len++;
+			*k += kappa;
+			return grisu_weed(digits, len, too_high_w, unsafe, rest, ten_pow[kappa] << -one.e, unit) ? len : 0;
 		}
-		else if ((unsigned char)(*p) < ' ') /* control character */
+	}
+	for (;;)
+	{
+		char d;
+		p2 *= 10;
+		unit *= 10;
+		unsafe *= 10;
+		d = (char)(p2 >> -one.e);
+		if (d || len) digits[len++] = (char)('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < unsafe)
 		{
-			escape = 1;
-			len += 5; // utf
+			*k += kappa;
+			return grisu_weed(digits, len, too_high_w * unit, unsafe, p2, one.f, unit) ? len : 0;
 		}
-		p++;
 	}
+}
 
-	if (!buf_append(len + 2)) return 0; // \" \"
-	buf_putc('\"');
+/**
+ *  \brief the double nearest to m * 10^q.
+ *  \param[in] m: decimal significand
+ *  \param[in] q: decimal exponent
+ *  \return number
+ */
+static double decimal_to_double(uint64_t m, int q)
+{
+	char text[48];
+	sprintf(text, "%llue%d", (unsigned long long)m, q); /* no decimal point, independent of locale */
+	return strtod(text, NULL);
+}
 
-	/* without escape characters */
-	if (!escape)
-	{
-		buf_puts(str, len);
-		buf_putc('\"');
-		return 1;
-	}
+/**
+ *  \brief exact shortest digits for the values grisu3 can not decide, based on the correctly rounded printf and strtod.
+ *  \param[in] v: number, positive and finite
+ *  \param[out] *digits: decimal digits, 17 at most
+ *  \param[out] *k: decimal exponent, v = digits * 10^k
+ *  \return number of digits
+ */
+static int shortest_exact(double v, char* digits, int* k)
+{
+	char text[48], *s;
+	uint64_t best_m = 0, m;
+	int lo = 1, hi = 17, p, q, best_q = 0;
+	double d;
 
-	p = str;
-	while (*p)
+	/* a p digit number reads back means a p+1 digit one does too, search for the least p */
+	while (lo <= hi)
 	{
-		if ((unsigned char)(*p) >= ' ' && *p != '\"' && *p != '\\')
+		p = (lo + hi) / 2;
+		/* the p digit number nearest to v, then the neighbour on the other side of v */
+		snprintf(text, sizeof(text), "%.*e", p - 1, v);
+		for (m = 0, s = text; *s && *s != 'e'; s++) if (*s >= '0' && *s <= '9') m = m * 10 + (uint64_t)(*s - '0');
+		q = (int)strtol(s + 1, NULL, 10) - (p - 1);
+		if ((d = decimal_to_double(m, q)) != v)
 		{
-			buf_putc(*p++);
+			m = d > v ? m - 1 : m + 1;
+			/* one digit less or more, already covered by the other lengths */
+			if (m < ten_pow[p - 1] || m >= ten_pow[p] || decimal_to_double(m, q) != v) { lo = p + 1; continue; }
 		}
-		else
+		best_m = m;
+		best_q = q;
+		hi = p - 1;
+	}
+	sprintf(text, "%llu", (unsigned long long)best_m);
+	p = (int)strlen(text);
+	memcpy(digits, text, p);
+	*k = best_q;
+	return p;
+}
+
+/**
+ *  \brief convert floating point number to text and append to buf.
+ *  \param[in] f: number
+ *  \param[in] buf: buf handle
+ *  \return 1 success or 0 fail
+ */
+static int print_float(double f, BUFFER* buf)
+{
+	char* p;
+	int len, k, kk;
+
+	/* sign, 17 digits, up to 6 leading zeros and the exponent */
+	if (!buf_append(32)) return 0;
+	p = buf_end();
+	if (f != f) { memcpy(p, "nan", 3); buf->end += 3; return 1; }
+	if (signbit(f)) { *p++ = '-'; f = -f; }
+	if (isinf(f)) { memcpy(p, "inf", 3); buf->end = (int)(p + 3 - buf->address); return 1; }
+	if (f == 0) { memcpy(p, "0.0", 3); buf->end = (int)(p + 3 - buf->address); return 1; }
+
+	len = grisu3(f, p, &k);
+	if (!len) len = shortest_exact(f, p, &k);
+	kk = len + k; /* 10^(kk-1) <= f < 10^kk */
+	if (k >= 0 && kk <= 21) /* integral, keep ".0" so it reads back as a float: 1234e2 -> 123400.0 */
+	{
+		memset(p + len, '0', k);
+		memcpy(p + kk, ".0", 2);
+		p += kk + 2;
+	}
+	else if (kk > 0 && kk <= 21) /* 1234e-2 -> 12.34 */
+	{
+		memmove(p + kk + 1, p + kk, len - kk);
+		p[kk] = '.';
+		p += len + 1;
+	}
+	else if (kk > -6 && kk <= 0) /* 1234e-6 -> 0.001234 */
+	{
+		memmove(p + 2 - kk, p, len);
+		p[0] = '0';
+		p[1] = '.';
+		memset(p + 2, '0', -kk);
+		p += len + 2 - kk;
+	}
+	else /* 1234e30 -> 1.234e33, 1e-7 */
+	{
+		if (len > 1)
 		{
-			/* escape and print */
-			buf_putc('\\');
-			if (*p == '\\') buf_putc('\\');
-			else if (*p == '\"') buf_putc('\"');
-			else if (*p == '\b') buf_putc('b');
-			else if (*p == '\f') buf_putc('f');
-			else if (*p == '\n') buf_putc('n');
-			else if (*p == '\r') buf_putc('r');
-			else if (*p == '\t') buf_putc('t');
-			else 
-			{
-				sprintf(buf_end(), "u%04x", (unsigned char)(*p));
-				buf->end += 5;
-			}
-			p++;
+			memmove(p + 2, p + 1, len - 1);
+			p[1] = '.';
+			p += len + 1;
 		}
+		else p++;
+		*p++ = 'e';
+		if (--kk < 0) { *p++ = '-'; kk = -kk; }
+		if (kk >= 100) { *p++ = (char)('0' + kk / 100); kk %= 100; memcpy(p, &digit_pairs[kk * 2], 2); p += 2; }
+		else if (kk >= 10) { memcpy(p, &digit_pairs[kk * 2], 2); p += 2; }
+		else *p++ = (char)('0' + kk);
 	}
-
-	buf_putc('\"');
+	buf->end = (int)(p - buf->address);
 
 	return 1;
 }
 
 /**
- *  \brief store json string conversion to buf.
+ *  \brief convert numbers in json to text and append to buf.
  *  \param[in] json: json handle
  *  \param[in] buf: buf handle
  *  \return 1 success or 0 fail
  */
-static int print_string(json_t json, BUFFER* buf)
+static int print_number(json_t json, BUFFER* buf)
 {
-	return print_string_buffer(_string(json), buf);
+	/* the number type is an integer */
+	if (json->info & JSON_NUMBER_INT) return print_int(_int(json), buf);
+	/* the type of number is a floating point type */
+	return print_float(_float(json), buf);
+}
+
+/**
+ *  \brief escape string and append to buf, without quotes.
+ *  \param[in] *str: address of string
+ *  \param[in] n: length of string
+ *  \param[in] buf: buf handle
+ *  \return 1 success or 0 fail
+ */
+static int print_escaped(const char* str, int n, BUFFER* buf)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char* e = str + n;
+	int k;
+
+	while (str < e)
+	{
+		/* copy the run without escape characters at once */
+		k = span_plain(str, (int)(e - str));
+		if (k > 0)
+		{
+			if (!buf_append(k)) return 0;
+			memcpy(buf_end(), str, k);
+			buf->end += k;
+			str += k;
+			if (str >= e) break;
+		}
+
+		/* escape and print */
+		if (!buf_append(6)) return 0;
+		buf_putc('\\');
+		if (*str == '\\') buf_putc('\\');
+		else if (*str == '\"') buf_putc('\"');
+		else if (*str == '\b') buf_putc('b');
+		else if (*str == '\f') buf_putc('f');
+		else if (*str == '\n') buf_putc('n');
+		else if (*str == '\r') buf_putc('r');
+		else if (*str == '\t') buf_putc('t');
+		else
+		{
+			buf_putc('u');
+			buf_putc('0');
+			buf_putc('0');
+			buf_putc(hex[(unsigned char)(*str) >> 4]);
+			buf_putc(hex[(unsigned char)(*str) & 15]);
+		}
+		str++;
+	}
+
+	return 1;
+}
+
+/**
+ *  \brief store c string conversion to buf.
+ *  \param[in] *str: address of string
+ *  \param[in] n: length of string
+ *  \param[in] buf: buf handle
+ *  \return 1 success or 0 fail
+ */
+static int print_string_n(const char* str, int n, BUFFER* buf)
+{
+	if (!buf_append(1)) return 0;
+	buf_putc('\"');
+	if (str && !print_escaped(str, n, buf)) return 0;
+	if (!buf_append(1)) return 0;
+	buf_putc('\"');
+	return 1;
+}
+
+/**
+ *  \brief store c string conversion to buf.
+ *  \param[in] *str: address of string, NULL gives empty string
+ *  \param[in] buf: buf handle
+ *  \return 1 success or 0 fail
+ */
+static int print_string_buffer(const char* str, BUFFER* buf)
+{
+	return print_string_n(str, str ? (int)strlen(str) : 0, buf);
+}
+
+/**
+ *  \brief store json string conversion to buf.
+ *  \param[in] json: json handle
+ *  \param[in] buf: buf handle
+ *  \return 1 success or 0 fail
+ */
+static int print_string(json_t json, BUFFER* buf)
+{
+	return print_string_buffer(_string(json), buf);
 }
 
 /**
@@ -1082,28 +1884,41 @@ static int print_value(json_t json, BUFFER* buf, int depth, int format)
  *  \return the address of the next meaningful character
  */
 json_t json_loads_options(const char* text, int check_end, const char** return_end)
+{
+	return json_context_loads(default_context(), text, check_end, return_end);
+}
+
+/**
+ *  \brief json text parser with context, the error is kept in the context.
+ *  \param[in] ctx: context
+ *  \param[in] *text: address of text
+ *  \param[in] check_end: check whether there are meaningless characters after the text after parsing
+ *  \param[out] **return_end: output the text address after parsing
+ *  \return json handle, delete it with json_context_delete
+ */
+json_t json_context_loads(json_context* ctx, const char* text, int check_end, const char** return_end)
 {
 	json_t json = NULL;
 
 	if (!text) return NULL;
 
 	/* reset error message */
-	error = NULL;
-	lbegin = text;
-	eline = 1;
-	etype = JSON_E_OK;
+	ctx->error = NULL;
+	ctx->lbegin = text;
+	ctx->eline = 1;
+	ctx->etype = JSON_E_OK;
 
 	/* start parsing the json text */
-	text = parse_value(skip(text), NULL, &json);
+	text = parse_value(ctx, skip(ctx, text), NULL, &json);
 	if (!text) return NULL; /* parse failure. error is set. */
 
 	/* check whether there are meaningless characters after the text after parsing */
 	if (check_end)
 	{
-		text = skip(text);
+		text = skip(ctx, text);
 		if (*text)
 		{
-			json_delete(json);
+			json_context_delete(ctx, json);
 			_error(JSON_E_END);
 			return NULL;
 		}
@@ -1125,6 +1940,382 @@ json_t json_loads(const char* text)
 	return json_loads_options(text, 0, NULL);
 }
 
+/* states of pull parser */
+#define PULL_VALUE							(0) /* expect a value */
+#define PULL_ARRAY_FIRST					(1) /* after '[', expect a value or ']' */
+#define PULL_OBJECT_FIRST					(2) /* after '{', expect a key or '}' */
+#define PULL_KEY							(3) /* after ',' in object, expect a key */
+#define PULL_COLON							(4) /* after key, expect ':' */
+#define PULL_NEXT							(5) /* after member, expect ',' or the closing bracket */
+#define PULL_DONE							(6) /* after the root value, only white space may follow */
+#define PULL_STRING							(7)
+#define PULL_ESCAPE							(8)
+#define PULL_UNICODE						(9)
+#define PULL_NUMBER							(10)
+#define PULL_LITERAL						(11)
+
+/* room kept in token for one input character of a string, a replayed \u escape writes at most 11 bytes */
+#define PULL_RESERVE						(16)
+
+#define _pull_object(p)						((p)->stack[((p)->depth - 1) >> 3] & (1 << (((p)->depth - 1) & 7)))
+
+/**
+ *  \brief initialize pull parser.
+ *  \param[in] p: pull parser
+ *  \param[in] *buffer: buffer for keys, numbers and pieces of strings
+ *  \param[in] size: size of buffer, at least 64
+ *  \return none
+ */
+void json_pull_init(json_pull* p, char* buffer, int size)
+{
+	memset(p, 0, sizeof(json_pull));
+	p->token = buffer;
+	p->size = size;
+	p->line = 1;
+	p->state = PULL_VALUE;
+	if (!buffer || size < 64) { p->etype = JSON_E_MEMORY; p->eline = 1; }
+}
+
+/**
+ *  \brief hand the next chunk of input to pull parser.
+ *  \param[in] p: pull parser
+ *  \param[in] *data: chunk, valid until json_pull_next returns JSON_PULL_MORE
+ *  \param[in] len: length of chunk, 0 marks the end of input
+ *  \return none
+ */
+void json_pull_feed(json_pull* p, const char* data, int len)
+{
+	p->in = data;
+	p->end = data + len;
+	if (len <= 0) p->last = 1;
+}
+
+/**
+ *  \brief get the error of pull parser, the same as json_error_info.
+ *  \param[in] p: pull parser
+ *  \param[out] *line: error line
+ *  \param[out] *column: error column
+ *  \return error type
+ */
+int json_pull_error_info(json_pull* p, int* line, int* column)
+{
+	if (!p->etype) return JSON_E_OK;
+	if (line) *line = p->eline;
+	if (column) *column = p->ecolumn;
+	return p->etype;
+}
+
+/**
+ *  \brief record error of pull parser.
+ *  \param[in] p: pull parser
+ *  \param[in] type: error type
+ *  \param[in] column: error column on the current line
+ *  \return JSON_PULL_ERROR
+ */
+static int pull_error(json_pull* p, int type, int column)
+{
+	p->etype = type;
+	p->eline = p->line;
+	p->ecolumn = column;
+	return JSON_PULL_ERROR;
+}
+
+/**
+ *  \brief state after a complete value.
+ *  \param[in] p: pull parser
+ *  \param[in] event: event of the value
+ *  \return event
+ */
+static int pull_value_end(json_pull* p, int event)
+{
+	p->state = p->depth ? PULL_NEXT : PULL_DONE;
+	return event;
+}
+
+/**
+ *  \brief start a token at the next input character.
+ *  \param[in] p: pull parser
+ *  \param[in] state: state of token
+ *  \return none
+ */
+static void pull_token(json_pull* p, int state)
+{
+	p->state = state;
+	p->len = 0;
+	p->tcolumn = p->column;
+}
+
+/**
+ *  \brief open array or object.
+ *  \param[in] p: pull parser
+ *  \param[in] object: open object
+ *  \return event
+ */
+static int pull_open(json_pull* p, int object)
+{
+	unsigned char* s;
+	if (p->depth >= JSON_PULL_DEPTH) return pull_error(p, JSON_E_MEMORY, p->column);
+	s = &p->stack[p->depth >> 3];
+	if (object) *s |= 1 << (p->depth & 7);
+	else *s &= ~(1 << (p->depth & 7));
+	p->depth++;
+	p->in++; p->column++;
+	p->state = object ? PULL_OBJECT_FIRST : PULL_ARRAY_FIRST;
+	return object ? JSON_PULL_BEGIN_OBJECT : JSON_PULL_BEGIN_ARRAY;
+}
+
+/**
+ *  \brief close array or object.
+ *  \param[in] p: pull parser
+ *  \return event
+ */
+static int pull_close(json_pull* p)
+{
+	int object = _pull_object(p);
+	p->depth--;
+	p->in++; p->column++;
+	return pull_value_end(p, object ? JSON_PULL_END_OBJECT : JSON_PULL_END_ARRAY);
+}
+
+static int pull_string(json_pull* p, int c);
+
+/**
+ *  \brief finish a \u escape, decode it as parse_string_buffer does.
+ *  \param[in] p: pull parser
+ *  \return 0 or the event of the replayed characters
+ */
+static int pull_unicode(json_pull* p)
+{
+	const char* q = p->esc;
+	char* o = p->token + p->len;
+	char replay[sizeof(p->esc)];
+	int n = p->nesc - 1, event = 0;
+
+	p->state = PULL_STRING;
+	json_utf(&q, &o);
+	if (q != p->esc) { p->len = (int)(o - p->token); return 0; }
+
+	/* invalid escape, the 'u' is dropped and the rest are ordinary characters */
+	memcpy(replay, p->esc + 1, n);
+	for (int i = 0; i < n; i++) event = pull_string(p, (unsigned char)replay[i]);
+	return event;
+}
+
+/**
+ *  \brief parse a character of key or string, the caller has checked the room in token.
+ *  \param[in] p: pull parser
+ *  \param[in] c: character
+ *  \return 0, JSON_PULL_KEY or JSON_PULL_STRING
+ */
+static int pull_string(json_pull* p, int c)
+{
+	unsigned int uc;
+	int i;
+
+	if (p->state == PULL_STRING)
+	{
+		if (c == '\"')
+		{
+			p->token[p->len] = 0;
+			if (p->key) { p->state = PULL_COLON; return JSON_PULL_KEY; }
+			return pull_value_end(p, JSON_PULL_STRING);
+		}
+		if (c == '\\') p->state = PULL_ESCAPE;
+		else p->token[p->len++] = c;
+		return 0;
+	}
+
+	if (p->state == PULL_ESCAPE)
+	{
+		p->state = PULL_STRING;
+		if (c == 'b') p->token[p->len++] = '\b';
+		else if (c == 'f') p->token[p->len++] = '\f';
+		else if (c == 'n') p->token[p->len++] = '\n';
+		else if (c == 'r') p->token[p->len++] = '\r';
+		else if (c == 't') p->token[p->len++] = '\t';
+		else if (c == 'u') { p->esc[0] = 'u'; p->nesc = 1; p->state = PULL_UNICODE; }
+		else p->token[p->len++] = c;
+		return 0;
+	}
+
+	/* \uXXXX, or \uXXXX\uXXXX for surrogate pair */
+	i = p->nesc;
+	p->esc[p->nesc++] = c;
+	p->esc[p->nesc] = 0;
+	if ((i == 5 && c != '\\') || (i == 6 && c != 'u') || (i != 5 && i != 6 && !isxdigit(c))) return pull_unicode(p);
+	if (i == 4)
+	{
+		uc = get_hex4(p->esc + 1);
+		if (uc < 0xD800 || uc > 0xDBFF) return pull_unicode(p);
+	}
+	if (i == 10) return pull_unicode(p);
+	return 0;
+}
+
+/**
+ *  \brief the number token has ended.
+ *  \param[in] p: pull parser
+ *  \return event
+ */
+static int pull_number(json_pull* p)
+{
+	const char* t = p->token;
+	double num;
+	int isint;
+
+	p->token[p->len] = 0;
+	isint = scan_number(&t, &num);
+	if (isint < 0) return pull_error(p, JSON_E_NUMBER, p->tcolumn + (int)(t - p->token));
+	/* only white space or punctuation may follow a number */
+	if (*t) return pull_error(p, p->depth ? JSON_E_INVALID : JSON_E_END, p->tcolumn + (int)(t - p->token));
+	if (isint) { p->int_ = (int)num; return pull_value_end(p, JSON_PULL_INT); }
+	p->float_ = num;
+	return pull_value_end(p, JSON_PULL_FLOAT);
+}
+
+/**
+ *  \brief the input has ended.
+ *  \param[in] p: pull parser
+ *  \return event
+ */
+static int pull_eof(json_pull* p)
+{
+	switch (p->state)
+	{
+	case PULL_DONE: return JSON_PULL_END;
+	case PULL_OBJECT_FIRST:
+	case PULL_KEY: return pull_error(p, JSON_E_GRAMMAR, p->column);
+	case PULL_COLON: return pull_error(p, JSON_E_INDICATOR, p->column);
+	case PULL_LITERAL: return pull_error(p, JSON_E_INVALID, p->tcolumn);
+	case PULL_NUMBER: return pull_number(p);
+	default: return pull_error(p, JSON_E_INVALID, p->column);
+	}
+}
+
+/**
+ *  \brief parse input until the next event.
+ *  \param[in] p: pull parser
+ *  \return event, JSON_PULL_MORE to feed the next chunk, JSON_PULL_END when the document is complete
+ */
+int json_pull_next(json_pull* p)
+{
+	int c, event;
+
+	if (p->etype) return JSON_PULL_ERROR;
+	if (p->part) { p->part = 0; p->len = 0; }
+
+	for (;;)
+	{
+		if (p->in >= p->end)
+		{
+			if (!p->last) return JSON_PULL_MORE;
+			return pull_eof(p);
+		}
+		c = (unsigned char)*p->in;
+
+		/* key or string */
+		if (p->state >= PULL_STRING && p->state <= PULL_UNICODE)
+		{
+			if (p->len + PULL_RESERVE > p->size - 1)
+			{
+				if (p->key) return pull_error(p, JSON_E_KEY, p->tcolumn);
+				p->token[p->len] = 0;
+				p->part = 1;
+				return JSON_PULL_STRING_PART;
+			}
+			/* plain run inside the chunk, copied at once */
+			if (p->state == PULL_STRING && c != '\"' && c != '\\')
+			{
+				int n = (int)(p->end - p->in), room = p->size - 1 - p->len;
+				n = span_string(p->in, n < room ? n : room);
+				memcpy(p->token + p->len, p->in, n);
+				p->len += n;
+				p->in += n; p->column += n;
+				continue;
+			}
+			p->in++; p->column++;
+			event = pull_string(p, c);
+			if (event) return event;
+			continue;
+		}
+
+		if (p->state == PULL_NUMBER)
+		{
+			if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')
+			{
+				if (p->len >= p->size - 1) return pull_error(p, JSON_E_NUMBER, p->tcolumn + p->len);
+				p->token[p->len++] = c;
+				p->in++; p->column++;
+				continue;
+			}
+			return pull_number(p);
+		}
+
+		if (p->state == PULL_LITERAL)
+		{
+			if (c != p->literal[p->len]) return pull_error(p, JSON_E_INVALID, p->tcolumn);
+			p->in++; p->column++;
+			if (p->literal[++p->len]) continue;
+			if (p->literal[0] == 'n') return pull_value_end(p, JSON_PULL_NULL);
+			p->int_ = p->literal[0] == 't' ? JSON_TRUE : JSON_FALSE;
+			return pull_value_end(p, JSON_PULL_BOOL);
+		}
+
+		/* skip white space, the same as skip() */
+		if (c && c <= ' ')
+		{
+			p->in++;
+			if (c == '\n') { p->line++; p->column = 1; }
+			else p->column++;
+			continue;
+		}
+
+		switch (p->state)
+		{
+		case PULL_ARRAY_FIRST:
+			if (c == ']') return pull_close(p);
+			/* fall through */
+		case PULL_VALUE:
+			if (c == '{') return pull_open(p, 1);
+			if (c == '[') return pull_open(p, 0);
+			if (c == '\"') { pull_token(p, PULL_STRING); p->key = 0; p->in++; p->column++; continue; }
+			if (c == '-' || (c >= '0' && c <= '9')) { pull_token(p, PULL_NUMBER); continue; }
+			if (c == 'n' || c == 't' || c == 'f')
+			{
+				pull_token(p, PULL_LITERAL);
+				p->literal = c == 'n' ? "null" : c == 't' ? "true" : "false";
+				continue;
+			}
+			return pull_error(p, JSON_E_INVALID, p->column);
+		case PULL_OBJECT_FIRST:
+			if (c == '}') return pull_close(p);
+			/* fall through */
+		case PULL_KEY:
+			if (c != '\"') return pull_error(p, JSON_E_GRAMMAR, p->column);
+			pull_token(p, PULL_STRING);
+			p->key = 1;
+			p->in++; p->column++;
+			continue;
+		case PULL_COLON:
+			if (c != ':') return pull_error(p, JSON_E_INDICATOR, p->column);
+			p->state = PULL_VALUE;
+			p->in++; p->column++;
+			continue;
+		case PULL_NEXT:
+			if (c == ',')
+			{
+				p->state = _pull_object(p) ? PULL_KEY : PULL_VALUE;
+				p->in++; p->column++;
+				continue;
+			}
+			if (c == (_pull_object(p) ? '}' : ']')) return pull_close(p);
+			return pull_error(p, JSON_E_INVALID, p->column);
+		default: /* PULL_DONE */
+			return pull_error(p, JSON_E_END, p->column);
+		}
+	}
+}
+
 /**
  *  \brief convert json to text, using a buffered strategy.
  *  \param[in] json: json handle
@@ -1134,18 +2325,33 @@ json_t json_loads(const char* text)
  *  \return address of converted text, free the char* when finished
  */
 char* json_dumps(json_t json, int preset, int unformat, int* len)
+{
+	return json_context_dumps(default_context(), json, preset, unformat, len);
+}
+
+/**
+ *  \brief convert json to text with context.
+ *  \param[in] ctx: context
+ *  \param[in] json: json handle
+ *  \param[in] preset: preset is a guess at the final size, guessing well reduces reallocation
+ *  \param[in] unformat: unformat=0 gives formatted, otherwise gives unformatted
+ *  \param[out] *len: address that receives the length of printed characters
+ *  \return address of converted text, free it with the free function of the context
+ */
+char* json_context_dumps(json_context* ctx, json_t json, int preset, int unformat, int* len)
 {
 	BUFFER p;
 
 	/* create and initialize dump buffer */
 	if (preset < 1) preset = 1;
-	p.address = (char*)json_malloc(preset);
+	memset(&p, 0, sizeof(p));
+	p.address = (char*)ctx->malloc_(preset);
 	if (!p.address) return NULL;
 	p.size = preset;
-	p.end = 0;
+	p.realloc_ = ctx->realloc_;
 
 	/* print json object */
-	if (!print_value(json, &p, 0, !unformat)) { free(p.address); return NULL; }
+	if (!print_value(json, &p, 0, !unformat) || !expansion(&p, 1)) { ctx->free_(p.address); return NULL; }
 
 	p.address[p.end] = '\0'; /* add string terminator */
 	if (len) *len = p.end; /* output length */
@@ -1153,6 +2359,236 @@ char* json_dumps(json_t json, int preset, int unformat, int* len)
 	return p.address;
 }
 
+/* state of open array or object in streaming writer */
+#define LEVEL_OBJECT			(1)			/* object, otherwise array */
+#define LEVEL_ITEMS				(2)			/* has members */
+#define LEVEL_LINES				(4)			/* formatted array with one member per line */
+#define LEVEL_STRING			(8)			/* a string value is being written in pieces */
+
+/**
+ *  \brief initialize streaming writer.
+ *  \param[in] w: writer
+ *  \param[in] format: 0 gives unformatted, otherwise gives formatted
+ *  \param[in] flush: sink of output, see json_buffer; NULL to grow buf.address with the realloc hook
+ *  \param[in] arg: user data of flush
+ *  \return none
+ */
+void json_writer_init(json_writer* w, int format, int (*flush)(json_buffer* buf, int needed), void* arg)
+{
+	memset(w, 0, sizeof(json_writer));
+	w->format = format;
+	w->buf.flush = flush;
+	w->buf.arg = arg;
+}
+
+/**
+ *  \brief write separator, indent and key before a value, the same layout as print_object and print_array.
+ *  \param[in] w: writer
+ *  \param[in] *key: key, required inside object
+ *  \param[in] container: the value is array or object
+ *  \return 1 success or 0 fail
+ */
+static int write_prefix(json_writer* w, const char* key, int container)
+{
+	BUFFER* buf = &w->buf;
+	unsigned char* l;
+	int i;
+
+	if (w->error) return 0;
+	if (w->depth == 0) { if (key) goto FAIL; return 1; }
+	l = &w->level[w->depth - 1];
+	if (*l & LEVEL_STRING) goto FAIL;
+
+	if (*l & LEVEL_OBJECT)
+	{
+		if (!key) goto FAIL;
+		if (!buf_append(2 + w->depth)) goto FAIL;
+		if (*l & LEVEL_ITEMS) buf_putc(',');
+		if (w->format) { buf_putc('\n'); for (i = 0; i < w->depth; i++) buf_putc('\t'); }
+		if (!print_string_buffer(key, buf)) goto FAIL;
+		if (!buf_append(2)) goto FAIL;
+		buf_putc(':');
+		if (w->format) buf_putc('\t');
+	}
+	else
+	{
+		if (key) goto FAIL;
+		/* print_array breaks lines when there are arrays or objects in the children, decided by the first one here */
+		if (!(*l & LEVEL_ITEMS) && w->format && container) *l |= LEVEL_LINES;
+		if (!buf_append(2 + w->depth)) goto FAIL;
+		if (*l & LEVEL_ITEMS) buf_putc(',');
+		if (*l & LEVEL_LINES) { buf_putc('\n'); for (i = 0; i < w->depth; i++) buf_putc('\t'); }
+		else if ((*l & LEVEL_ITEMS) && w->format) buf_putc(' ');
+	}
+	*l |= LEVEL_ITEMS;
+	return 1;
+
+FAIL:
+	w->error = 1;
+	return 0;
+}
+
+/**
+ *  \brief open array or object.
+ *  \param[in] w: writer
+ *  \param[in] *key: key, required inside object
+ *  \param[in] object: 1 object or 0 array
+ *  \return 1 success or 0 fail
+ */
+static int write_begin(json_writer* w, const char* key, int object)
+{
+	BUFFER* buf = &w->buf;
+	if (!write_prefix(w, key, 1)) return 0;
+	if (w->depth >= JSON_WRITER_DEPTH || !buf_append(1)) { w->error = 1; return 0; }
+	buf_putc(object ? '{' : '[');
+	w->level[w->depth++] = object ? LEVEL_OBJECT : 0;
+	return 1;
+}
+
+/**
+ *  \brief close array or object.
+ *  \param[in] w: writer
+ *  \param[in] object: 1 object or 0 array
+ *  \return 1 success or 0 fail
+ */
+static int write_end(json_writer* w, int object)
+{
+	BUFFER* buf = &w->buf;
+	unsigned char l;
+	int i;
+
+	if (w->error) return 0;
+	if (w->depth == 0) { w->error = 1; return 0; }
+	l = w->level[w->depth - 1];
+	if (!(l & LEVEL_OBJECT) != !object || (l & LEVEL_STRING)) { w->error = 1; return 0; }
+	w->depth--;
+	if (!buf_append(2 + w->depth)) { w->error = 1; return 0; }
+	if ((object && w->format && (l & LEVEL_ITEMS)) || (l & LEVEL_LINES))
+	{
+		buf_putc('\n');
+		for (i = 0; i < w->depth; i++) buf_putc('\t');
+	}
+	buf_putc(object ? '}' : ']');
+	return 1;
+}
+
+int json_write_begin_object(json_writer* w, const char* key)
+{
+	return write_begin(w, key, 1);
+}
+
+int json_write_end_object(json_writer* w)
+{
+	return write_end(w, 1);
+}
+
+int json_write_begin_array(json_writer* w, const char* key)
+{
+	return write_begin(w, key, 0);
+}
+
+int json_write_end_array(json_writer* w)
+{
+	return write_end(w, 0);
+}
+
+/**
+ *  \brief write a literal value.
+ *  \param[in] w: writer
+ *  \param[in] *key: key, required inside object
+ *  \param[in] *text: literal text
+ *  \param[in] len: length of text
+ *  \return 1 success or 0 fail
+ */
+static int write_literal(json_writer* w, const char* key, const char* text, int len)
+{
+	BUFFER* buf = &w->buf;
+	if (!write_prefix(w, key, 0)) return 0;
+	if (!buf_append(len)) { w->error = 1; return 0; }
+	buf_puts(text, len);
+	return 1;
+}
+
+int json_write_null(json_writer* w, const char* key)
+{
+	return write_literal(w, key, "null", 4);
+}
+
+int json_write_bool(json_writer* w, const char* key, int b)
+{
+	return b == JSON_FALSE ? write_literal(w, key, "false", 5) : write_literal(w, key, "true", 4);
+}
+
+int json_write_int(json_writer* w, const char* key, int num)
+{
+	if (!write_prefix(w, key, 0)) return 0;
+	if (!print_int(num, &w->buf)) { w->error = 1; return 0; }
+	return 1;
+}
+
+int json_write_float(json_writer* w, const char* key, double num)
+{
+	if (!write_prefix(w, key, 0)) return 0;
+	if (!print_float(num, &w->buf)) { w->error = 1; return 0; }
+	return 1;
+}
+
+int json_write_string(json_writer* w, const char* key, const char* string)
+{
+	return json_write_string_n(w, key, string, string ? (int)strlen(string) : 0);
+}
+
+int json_write_string_n(json_writer* w, const char* key, const char* string, int len)
+{
+	if (!write_prefix(w, key, 0)) return 0;
+	if (!print_string_n(string, len, &w->buf)) { w->error = 1; return 0; }
+	return 1;
+}
+
+/**
+ *  \brief start a string value written in pieces, a pseudo level keeps other values out until json_write_string_end.
+ *  \param[in] w: writer
+ *  \param[in] *key: key, required inside object
+ *  \return 1 success or 0 fail
+ */
+int json_write_string_begin(json_writer* w, const char* key)
+{
+	if (!write_literal(w, key, "\"", 1)) return 0;
+	if (w->depth >= JSON_WRITER_DEPTH) { w->error = 1; return 0; }
+	w->level[w->depth++] = LEVEL_STRING;
+	return 1;
+}
+
+int json_write_string_append(json_writer* w, const char* string, int len)
+{
+	if (w->error) return 0;
+	if (w->depth == 0 || w->level[w->depth - 1] != LEVEL_STRING) { w->error = 1; return 0; }
+	if (!print_escaped(string, len, &w->buf)) { w->error = 1; return 0; }
+	return 1;
+}
+
+int json_write_string_end(json_writer* w)
+{
+	BUFFER* buf = &w->buf;
+	if (w->error) return 0;
+	if (w->depth == 0 || w->level[w->depth - 1] != LEVEL_STRING || !buf_append(1)) { w->error = 1; return 0; }
+	w->depth--;
+	buf_putc('\"');
+	return 1;
+}
+
+/**
+ *  \brief finish writing, all arrays and objects must be closed.
+ *  \param[in] w: writer
+ *  \return 1 success or 0 fail
+ */
+int json_write_finish(json_writer* w)
+{
+	if (w->error || w->depth) { w->error = 1; return 0; }
+	if (w->buf.flush && !w->buf.flush(&w->buf, 0)) { w->error = 1; return 0; }
+	return 1;
+}
+
 /**
  *  \brief get the size(count) of json, the _type is an array or object.
  *  \param[in] json: json handle
@@ -1160,13 +2596,9 @@ char* json_dumps(json_t json, int preset, int unformat, int* len)
  */
 int json_get_size(json_t json)
 {
-	json_t c;
-	int i = 0;
 	if (!json) return 0;
 	if (_type(json->info) != JSON_TYPE_ARRAY && _type(json->info) != JSON_TYPE_OBJECT) return 0;
-	c = _child(json);
-	while (c) { i++; c = c->next; }
-	return i;
+	return _size(json);
 }
 
 /**
@@ -1179,6 +2611,17 @@ int json_get_size(json_t json)
 static json_t json_prev(json_t json, const char* key, int index)
 {
 	json_t c, t = json, prev = NULL;
+
+	/* find the target by index, then its previous node by address only */
+	if (key && index == 0 && _size(json) >= JSON_INDEX_MIN && index_lookup(json, key, &t))
+	{
+		if (!t) return json;
+		if (t == _child(json)) return NULL;
+		for (c = _child(json); c->next != t; c = c->next) ;
+		return c;
+	}
+
+	t = json;
 	c = _child(json);
 	while (c)
 	{
@@ -1203,11 +2646,12 @@ static json_t json_prev(json_t json, const char* key, int index)
  */
 json_t json_get_child(json_t json, const char* key, int index)
 {
-	json_t prev;
+	json_t prev, found;
 	if (!json) return NULL;
 	if (index < 0) return NULL; 
 	if (key && _type(json->info) == JSON_TYPE_ARRAY) return NULL;
 	if (_type(json->info) != JSON_TYPE_ARRAY && _type(json->info) != JSON_TYPE_OBJECT) return NULL;
+	if (key && index == 0 && _size(json) >= JSON_INDEX_MIN && index_lookup(json, key, &found)) return found;
 	prev = json_prev(json, key, index);
 	return (prev != json) ? (prev ? prev->next : _child(json)) : NULL;
 }
@@ -1275,6 +2719,13 @@ json_t json_attach(json_t json, int index, json_t item)
 	if (!(_type(json->info) == JSON_TYPE_ARRAY && !(item->info & JSON_WITH_KEY)) &&
 		!(_type(json->info) == JSON_TYPE_OBJECT && (item->info & JSON_WITH_KEY))) return NULL;
 
+	/* append to the tail directly */
+	if (index >= _size(json))
+	{
+		json_append(json, item);
+		return item;
+	}
+
 	c = _child(json);
 	while (c && index > 0)
 	{
@@ -1283,17 +2734,13 @@ json_t json_attach(json_t json, int index, json_t item)
 		index--;
 	}
 
-	if (!c && !prev)
-	{
-		_child(json) = item;
-		return item;
-	}
-
 	/* adjust link */
 	if (prev) prev->next = item;
 	item->next = c;
 
 	if (c == _child(json)) _child(json) = item;
+	_size(json)++;
+	if (item->info & JSON_WITH_KEY) index_add(json, item);
 
 	return item;
 }
@@ -1329,6 +2776,9 @@ json_t json_detach(json_t json, char *key, int index)
 		c = _child(json);
 		_child(json) = c->next;
 	}
+	if (c == _tail(json)) _tail(json) = prev;
+	_size(json)--;
+	if (c->info & JSON_WITH_KEY) index_remove(json, c);
 
 	c->next = NULL; /* detach */
 
@@ -1353,6 +2803,8 @@ json_t json_replace(json_t json, char *key, int index, json_t item)
 	if (index < 0) return NULL;
 	if (key && _type(json->info) == JSON_TYPE_ARRAY) return NULL;
 	if (_type(json->info) != JSON_TYPE_ARRAY && _type(json->info) != JSON_TYPE_OBJECT) return NULL;
+	/* same rule as json_attach, children of object are looked up by key */
+	if (_type(json->info) == JSON_TYPE_OBJECT && !(item->info & JSON_WITH_KEY)) return NULL;
 
 	/* adjust link */
 	prev = json_prev(json, key, index);
@@ -1368,6 +2820,8 @@ json_t json_replace(json_t json, char *key, int index, json_t item)
 		_child(json) = item;
 	}
 	item->next = c->next;
+	if (c == _tail(json)) _tail(json) = item;
+	if (c->info & JSON_WITH_KEY) { index_remove(json, c); index_add(json, item); }
 
 	c->next = NULL;
 	json_delete(c);
@@ -1390,7 +2844,7 @@ json_t json_create_null(char* key)
 		if (!k) return NULL;
 	}
 
-	item = json_new(JSON_TYPE_NULL, k);
+	item = json_new(json_malloc, JSON_TYPE_NULL, k);
 	if (!item) { json_free(k); return NULL; }
 
 	return item;
@@ -1412,7 +2866,7 @@ json_t json_create_bool(char* key, int b)
 		if (!k) return NULL;
 	}
 
-	item = json_new(JSON_TYPE_BOOL, k);
+	item = json_new(json_malloc, JSON_TYPE_BOOL, k);
 	if (!item) { json_free(k); return NULL; }
 	if (b != JSON_FALSE) item->info |= JSON_VALUE_B_TRUE;
 
@@ -1435,7 +2889,7 @@ json_t json_create_int(char* key, int num)
 		if (!k) return NULL;
 	}
 
-	item = json_new(JSON_TYPE_NUMBER | JSON_NUMBER_INT, k);
+	item = json_new(json_malloc, JSON_TYPE_NUMBER | JSON_NUMBER_INT, k);
 	if (!item) { json_free(k); return NULL; }
 	_int(item) = num;
 
@@ -1458,7 +2912,7 @@ json_t json_create_float(char* key, double num)
 		if (!k) return NULL;
 	}
 
-	item = json_new(JSON_TYPE_NUMBER, k);
+	item = json_new(json_malloc, JSON_TYPE_NUMBER, k);
 	if (!item) { json_free(k); return NULL; }
 	_float(item) = num;
 
@@ -1482,7 +2936,7 @@ json_t json_create_string(char* key, const char* string)
 		if (!k) return NULL;
 	}
 
-	item = json_new(JSON_TYPE_STRING, k);
+	item = json_new(json_malloc, JSON_TYPE_STRING, k);
 	if (!item) { json_free(k); return NULL; }
 
 	s = json_strdup(string);
@@ -1508,7 +2962,7 @@ json_t json_create_object(char* key)
 		if (!k) return NULL;
 	}
 
-	item = json_new(JSON_TYPE_OBJECT, k);
+	item = json_new(json_malloc, JSON_TYPE_OBJECT, k);
 	if (!item) { json_free(k); return NULL; }
 
 	return item;
@@ -1529,7 +2983,7 @@ json_t json_create_array(char* key)
 		if (!k) return NULL;
 	}
 
-	item = json_new(JSON_TYPE_ARRAY, k);
+	item = json_new(json_malloc, JSON_TYPE_ARRAY, k);
 	if (!item) { json_free(k); return NULL; }
 
 	return item;
@@ -1544,7 +2998,7 @@ json_t json_create_array(char* key)
 json_t json_create_array_int(char* key, const int* numbers, int count)
 {
 	int i;
-	json_t n = NULL, p = NULL;
+	json_t n = NULL;
 	json_t a = json_create_array(key);
 
 	if (!a) return NULL;
@@ -1552,9 +3006,7 @@ json_t json_create_array_int(char* key, const int* numbers, int count)
 	{
 		n = json_create_int(NULL, numbers[i]);
 		if (!n) { json_delete(a); return NULL; }
-		if (!i) _child(a) = n;
-		else p->next = n;
-		p = n;
+		json_append(a, n);
 	}
 
 	return a;
@@ -1569,7 +3021,7 @@ json_t json_create_array_int(char* key, const int* numbers, int count)
 json_t json_create_array_float(char* key, const float* numbers, int count)
 {
 	int i;
-	json_t n = NULL, p = NULL;
+	json_t n = NULL;
 	json_t a = json_create_array(key);
 
 	if (!a) return NULL;
@@ -1577,9 +3029,7 @@ json_t json_create_array_float(char* key, const float* numbers, int count)
 	{
 		n = json_create_float(NULL, numbers[i]);
 		if (!n) { json_delete(a); return NULL; }
-		if (!i) _child(a) = n;
-		else p->next = n;
-		p = n;
+		json_append(a, n);
 	}
 
 	return a;
@@ -1594,7 +3044,7 @@ json_t json_create_array_float(char* key, const float* numbers, int count)
 json_t json_create_array_double(char* key, const double* numbers, int count)
 {
 	int i;
-	json_t n = NULL, p = NULL;
+	json_t n = NULL;
 	json_t a = json_create_array(key);
 
 	if (!a) return NULL;
@@ -1602,9 +3052,7 @@ json_t json_create_array_double(char* key, const double* numbers, int count)
 	{
 		n = json_create_float(NULL, numbers[i]);
 		if (!n) { json_delete(a); return NULL; }
-		if (!i) _child(a) = n;
-		else p->next = n;
-		p = n;
+		json_append(a, n);
 	}
 
 	return a;
@@ -1619,7 +3067,7 @@ json_t json_create_array_double(char* key, const double* numbers, int count)
 json_t json_create_array_string(char* key, const char** strings, int count)
 {
 	int i;
-	json_t n = NULL, p = NULL;
+	json_t n = NULL;
 	json_t a = json_create_array(key);
 
 	if (!a) return NULL;
@@ -1627,9 +3075,7 @@ json_t json_create_array_string(char* key, const char** strings, int count)
 	{
 		n = json_create_string(NULL, strings[i]);
 		if (!n) { json_delete(a); return NULL; }
-		if (!i) _child(a) = n;
-		else p->next = n;
-		p = n;
+		json_append(a, n);
 	}
 
 	return a;
@@ -1657,6 +3103,7 @@ int json_set_key(json_t json, const char* key)
 
 	json_free(old);
 	_key(json) = k;
+	__atomic_add_fetch(&key_epoch, 1, __ATOMIC_RELAXED); /* the parent is unknown, invalidate all indexes */
 
 	return 1;
 }
@@ -1739,7 +3186,7 @@ int json_set_string(json_t json, const char* string)
  */
 json_t json_duplicate(json_t json)
 {
-	json_t n, temp, child, prev = NULL;
+	json_t n, temp, child;
 	char* key = NULL;
 
 	if (!json) return NULL;
@@ -1752,9 +3199,15 @@ json_t json_duplicate(json_t json)
 	}
 
 	/* create new json */
-	n = json_new(json->info, key);
+	n = json_new(json_malloc, json->info, key);
 	if (!n) return NULL;
 
+	/* copy number type json */
+	if (_type(json->info) == JSON_TYPE_NUMBER)
+	{
+		memcpy(json_value_address(n), json_value_address(json), sizeof(number));
+	}
+
 	/* copy string type json */
 	if (_type(json->info) == JSON_TYPE_STRING)
 	{
@@ -1770,16 +3223,7 @@ json_t json_duplicate(json_t json)
 		{
 			child = json_duplicate(temp);
 			if (!child) { json_delete(n); return NULL; }
-			if (prev)
-			{
-				prev->next = child;
-				prev = child;
-			}
-			else
-			{
-				_child(n) = child;
-				prev = child;
-			}
+			json_append(n, child);
 			temp = temp->next;
 		}
 	}
@@ -1850,7 +3294,7 @@ json_t json_file_load(char* filename)
 	
 	/* load text */
 	json = json_loads(text);
-	if (!json) json_report_error();
+	if (!json) json_report_error(&local_context);
 
 	json_free(text);
 
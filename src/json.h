@@ -76,14 +76,131 @@ typedef void* (*realloc_t)(void* block, size_t size);
 /* for different platforms, set different memory hook functions, the default is POSIX standard */
 int json_set_hooks(malloc_t _malloc, free_t _free, realloc_t _realloc);
 
+/* output buffer of dump and streaming writer */
+typedef struct _json_buffer {
+    char* address;  /* output window */
+    int size;       /* size of window */
+    int end;        /* used bytes of window */
+    /* if not NULL, called when the window is short of needed bytes: take over [0, end) and provide a new window,
+       needed is 0 when the writer finishes; if NULL, the window grows with the realloc hook */
+    int (*flush)(struct _json_buffer* buf, int needed);
+    void* arg;      /* user data of flush */
+    realloc_t realloc_; /* grows the window when flush is NULL, NULL for the realloc hook */
+} json_buffer;
+
+/* streaming writer, emits text directly without building a tree */
+#define JSON_WRITER_DEPTH       (32) /* max nesting depth of streaming writer */
+typedef struct {
+    json_buffer buf;
+    int format;     /* 0 gives unformatted, otherwise gives formatted the same as json_dumps */
+    int depth;      /* number of open arrays and objects */
+    int error;      /* set when writing fails or the calls are not paired */
+    unsigned char level[JSON_WRITER_DEPTH]; /* state of open arrays and objects */
+} json_writer;
+
+/* the key is required inside an object and must be NULL inside an array or at the top level */
+void json_writer_init(json_writer* w, int format, int (*flush)(json_buffer* buf, int needed), void* arg);
+int json_write_begin_object(json_writer* w, const char* key);
+int json_write_end_object(json_writer* w);
+int json_write_begin_array(json_writer* w, const char* key);
+int json_write_end_array(json_writer* w);
+int json_write_null(json_writer* w, const char* key);
+int json_write_bool(json_writer* w, const char* key, int b);
+int json_write_int(json_writer* w, const char* key, int num);
+int json_write_float(json_writer* w, const char* key, double num);
+int json_write_string(json_writer* w, const char* key, const char* string);
+int json_write_string_n(json_writer* w, const char* key, const char* string, int len);
+/* a string value written in several pieces, such as a chain of buffers */
+int json_write_string_begin(json_writer* w, const char* key);
+int json_write_string_append(json_writer* w, const char* string, int len);
+int json_write_string_end(json_writer* w);
+/* flush the rest, return 1 success or 0 fail */
+int json_write_finish(json_writer* w);
+
 /* load json */
 json_t json_loads(const char* text);
 json_t json_loads_options(const char* text, int check_end, const char** return_end);
 json_t json_file_load(char* filename);
 
-/* when loading fails, use this method to locate the error */
+/* when loading fails, use this method to locate the error, the error is kept per thread */
 int json_error_info(int* line, int* column);
 
+/* parser and serializer context, carries its own allocator and error state */
+/* threads may parse and dump at the same time each with its own context, a tree is used by one thread at a time */
+typedef struct
+{
+    malloc_t malloc_;
+    free_t free_;
+    realloc_t realloc_;
+    const char* error;  /* pointer to error */
+    const char* lbegin; /* beginning of error line */
+    int eline;          /* line of error */
+    int etype;          /* type of error */
+} json_context;
+
+/* all three NULL to use the functions set by json_set_hooks */
+int json_context_init(json_context* ctx, malloc_t _malloc, free_t _free, realloc_t _realloc);
+json_t json_context_loads(json_context* ctx, const char* text, int check_end, const char** return_end);
+int json_context_error_info(json_context* ctx, int* line, int* column);
+/* the text is freed with the free function of the context */
+char* json_context_dumps(json_context* ctx, json_t json, int preset, int unformat, int* len);
+/* delete a tree loaded by the context */
+void json_context_delete(json_context* ctx, json_t json);
+
+/* events of pull parser */
+#define JSON_PULL_ERROR         (-1) // see json_pull_error_info
+#define JSON_PULL_MORE          (0) // input used up, feed the next chunk
+#define JSON_PULL_END           (1) // the document is complete
+#define JSON_PULL_BEGIN_OBJECT  (2)
+#define JSON_PULL_END_OBJECT    (3)
+#define JSON_PULL_BEGIN_ARRAY   (4)
+#define JSON_PULL_END_ARRAY     (5)
+#define JSON_PULL_KEY           (6) // token is the key
+#define JSON_PULL_NULL          (7)
+#define JSON_PULL_BOOL          (8) // int_ is JSON_TRUE or JSON_FALSE
+#define JSON_PULL_INT           (9) // int_ is the value
+#define JSON_PULL_FLOAT         (10) // float_ is the value
+#define JSON_PULL_STRING        (11) // token is the value, or the last piece of it
+#define JSON_PULL_STRING_PART   (12) // token is a piece of a string longer than the buffer, more follows
+
+#define JSON_PULL_DEPTH         (256)
+
+/* pull parser, input arrives in chunks and memory stays within the token buffer given by the caller */
+typedef struct
+{
+    char* token;            /* key or string of the current event, NUL terminated */
+    int len;                /* length of token */
+    int int_;               /* value of int and bool */
+    double float_;          /* value of float */
+    int depth;              /* nesting depth after the current event */
+
+    /* parser state */
+    int size;               /* size of token buffer */
+    int state;
+    int key;                /* the string being parsed is a key */
+    int part;               /* token was handed out as a part */
+    int last;               /* no more input after the current chunk */
+    const char* in;         /* unread input */
+    const char* end;
+    const char* literal;    /* "null", "true" or "false" being matched */
+    int line;               /* position of the next input character, as json_error_info */
+    int column;
+    int tcolumn;            /* column where the current token began */
+    int eline;
+    int ecolumn;
+    int etype;
+    char esc[12];           /* pending \u escape */
+    int nesc;
+    unsigned char stack[JSON_PULL_DEPTH / 8]; /* one bit per level, set for object */
+} json_pull;
+
+/* buffer holds keys, numbers and pieces of strings, at least 64 bytes; keys must fit in it */
+void json_pull_init(json_pull* p, char* buffer, int size);
+/* the chunk must stay valid until json_pull_next returns JSON_PULL_MORE, len 0 marks the end of input */
+void json_pull_feed(json_pull* p, const char* data, int len);
+int json_pull_next(json_pull* p);
+int json_pull_error_info(json_pull* p, int* line, int* column);
+
 /* dump json */
 char* json_dumps(json_t json, int preset, int unformat, int* len);
 int json_file_dump(json_t json, char* filename);
@@ -100,6 +217,7 @@ json_t json_value_object(json_t json);
 
 /* get information of array/object json */
 /* This type of method is only valid for json that is an array or object */
+/* objects with many keys are looked up by key through a hash index built on first use */
 int json_get_size(json_t json);
 json_t json_get_child(json_t json, const char* key, int index);
 json_t json_get_by_indexs(json_t json, int index, ...);
@@ -149,7 +267,7 @@ void json_minify(char* text);
 #define json_erase_by_key(json, key)            json_erase(json, key, 0)
 
 /* add json item to array */
-/* The default is the tail plug, the insertion efficiency is low, it can be changed to the head plug according to the actual situation */
+/* The default is the tail plug, containers keep a tail pointer so appending is O(1) */
 #define json_add_null_to_array(json)            (json_isarray(json) ? json_attach((json), JSON_TAIL, json_create_null(NULL)) : NULL)
 #define json_add_bool_to_array(json, b)         (json_isarray(json) ? json_attach((json), JSON_TAIL, json_create_bool(NULL, (b))) : NULL)
 #define json_add_int_to_array(json, n)          (json_isarray(json) ? json_attach((json), JSON_TAIL, json_create_int(NULL, (n))) : NULL)
@@ -159,7 +277,7 @@ void json_minify(char* text);
 #define json_add_object_to_array(json)          (json_isarray(json) ? json_attach((json), JSON_TAIL, json_create_object(NULL)) : NULL)
 
 /* add json item to object */
-/* The default is the tail plug, the insertion efficiency is low, it can be changed to the head plug according to the actual situation */
+/* The default is the tail plug, containers keep a tail pointer so appending is O(1) */
 #define json_add_null_to_object(json, key)      ((json_isobject(json) && (key)) ? json_attach((json), JSON_TAIL, json_create_null(key)) : NULL)
 #define json_add_bool_to_object(json, key, b)   ((json_isobject(json) && (key)) ? json_attach((json), JSON_TAIL, json_create_bool(key, (b))) : NULL)
 #define json_add_int_to_object(json, key, n)    ((json_isobject(json) && (key)) ? json_attach((json), JSON_TAIL, json_create_int(key, (n))) : NULL)
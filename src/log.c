@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "log.h"
+
+#define LOG_OUT_SIZE (64 * 1024)	/* 后台线程一次 write 的最大数据量 */
+
+/* 环形缓冲区中的一条记录，格式化前的原始数据 */
+typedef struct _log_record
+{
+	unsigned long seq;				/* 等于写入位置 + 1 时记录已就绪 */
+	unsigned long long usec;		/* 墙上时间（微秒） */
+	const char *tag;				/* 原始字节记录的标签，文本记录为 NULL */
+	int total;						/* 原始字节的总长度 */
+	int suppressed;					/* 该调用点此前被限流丢弃的条数 */
+	unsigned short len;
+	unsigned char level;
+	char data[LOG_PAYLOAD];
+} log_record;
+
+int log_level = LOGL_INFO;
+
+static log_record ring[LOG_SLOTS];
+static unsigned long ring_head;		/* 生产者竞争的写入位置 */
+static unsigned long ring_tail;		/* 只由持有 drain_lock 的消费者修改 */
+static unsigned long dropped;		/* 缓冲区满时丢弃的记录数 */
+static int log_fd = -1;
+static int log_efd = -1;			/* 后台线程休眠时等待的唤醒通知 */
+static int log_sleeping;			/* 后台线程已经或即将阻塞在 log_efd 上 */
+static int log_ready;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char level_chars[] = "EWID";
+static const char *level_names[] = { "error", "warn", "info", "debug" };
+
+static unsigned long long wall_usec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*同一调用点每秒最多 LOG_RATE 条，窗口切换时的竞争只会多放过几条*/
+static int site_allow(log_site *site, unsigned long sec)
+{
+	if (__atomic_load_n(&site->window, __ATOMIC_RELAXED) != sec) {
+		__atomic_store_n(&site->window, sec, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+	}
+	if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > LOG_RATE) {
+		__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ *  有界多生产者队列：每个槽位的 seq 表示它能被哪个写入位置占用，
+ *  生产者 CAS 抢到位置后填写记录，再发布 seq；缓冲区满时返回 NULL。
+ */
+static log_record *ring_reserve(unsigned long *ppos)
+{
+	unsigned long pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+	for (;;) {
+		log_record *r = &ring[pos & (LOG_SLOTS - 1)];
+		long diff = (long)(__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				*ppos = pos;
+				return r;
+			}
+		} else if (diff < 0) {
+			__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/*
+ *  发布记录；后台线程休眠时由抢到 log_sleeping 的生产者唤醒它，
+ *  其余情况下不做系统调用。栅栏与 log_thread 中的配对，
+ *  保证要么生产者看到休眠标志，要么后台线程看到这条记录。
+ */
+static void ring_publish(log_record *r, unsigned long pos)
+{
+	unsigned long long one = 1;
+	__atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&log_sleeping, __ATOMIC_RELAXED) &&
+		__atomic_exchange_n(&log_sleeping, 0, __ATOMIC_RELAXED)) {
+		if (write(log_efd, &one, sizeof(one)) < 0)
+			perror("log eventfd write");
+	}
+}
+
+/*占用一个槽位并填写公共字段，限流或缓冲区满时返回 NULL*/
+static log_record *record_begin(log_site *site, int level, unsigned long *pos)
+{
+	unsigned long long now = wall_usec();
+	log_record *r;
+
+	if (!site_allow(site, now / 1000000))
+		return NULL;
+	if (!(r = ring_reserve(pos)))
+		return NULL;
+	r->usec = now;
+	r->level = level;
+	r->suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+	return r;
+}
+
+/*文本记录：在调用线程格式化，直接写入槽位*/
+void log_site_printf(log_site *site, int level, const char *fmt, ...)
+{
+	unsigned long pos;
+	log_record *r;
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	if (!log_ready) {
+		/* 日志线程启动前（或创建失败）直接输出 */
+		vfprintf(stderr, fmt, ap);
+		fputc('\n', stderr);
+		va_end(ap);
+		return;
+	}
+	if ((r = record_begin(site, level, &pos)) != NULL) {
+		n = vsnprintf(r->data, LOG_PAYLOAD, fmt, ap);
+		r->len = n < 0 ? 0 : n >= LOG_PAYLOAD ? LOG_PAYLOAD - 1 : n;
+		r->tag = NULL;
+		r->total = r->len;
+		ring_publish(r, pos);
+	}
+	va_end(ap);
+}
+
+/*原始字节记录：只拷贝前 LOG_PAYLOAD 个字节，转义由后台线程完成*/
+void log_site_raw(log_site *site, int level, const char *tag, const void *data, int len, int total)
+{
+	unsigned long pos;
+	log_record *r;
+
+	if (!log_ready) {
+		fprintf(stderr, "%s %.*s\n", tag, len, (const char *)data);
+		return;
+	}
+	if ((r = record_begin(site, level, &pos)) != NULL) {
+		if (len > LOG_PAYLOAD)
+			len = LOG_PAYLOAD;
+		memcpy(r->data, data, len);
+		r->len = len;
+		r->tag = tag;
+		r->total = total > len ? total : len;
+		ring_publish(r, pos);
+	}
+}
+
+static void write_all(const char *p, int len)
+{
+	while (len > 0) {
+		int n = write(log_fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		p += n;
+		len -= n;
+	}
+}
+
+/*控制字符转义，保证每条记录一行*/
+static int escape_bytes(char *dst, const char *src, int len)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i, n = 0;
+
+	for (i = 0; i < len; i++) {
+		unsigned char ch = src[i];
+		if (ch == '\r' || ch == '\n' || ch == '\t') {
+			dst[n++] = '\\';
+			dst[n++] = ch == '\r' ? 'r' : ch == '\n' ? 'n' : 't';
+		} else if (ch < 0x20 || ch == 0x7f) {
+			dst[n++] = '\\';
+			dst[n++] = 'x';
+			dst[n++] = hex[ch >> 4];
+			dst[n++] = hex[ch & 15];
+		} else {
+			dst[n++] = ch;
+		}
+	}
+	return n;
+}
+
+/*格式化一条记录，返回写入的长度；时间前缀按秒缓存*/
+static int record_format(char *out, const log_record *r)
+{
+	static time_t last_sec = -1;
+	static char stamp[32];
+	time_t sec = r->usec / 1000000;
+	int n, len = r->len;
+	struct tm tm;
+
+	if (sec != last_sec) {
+		localtime_r(&sec, &tm);
+		strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+		last_sec = sec;
+	}
+	n = sprintf(out, "%s.%06u %c ", stamp, (unsigned)(r->usec % 1000000), level_chars[r->level]);
+	if (r->tag) {
+		n += sprintf(out + n, "%s ", r->tag);
+		n += escape_bytes(out + n, r->data, len);
+		if (r->total > len)
+			n += sprintf(out + n, " ... (+%d bytes)", r->total - len);
+	} else {
+		while (len > 0 && r->data[len - 1] == '\n')
+			len--;
+		memcpy(out + n, r->data, len);
+		n += len;
+	}
+	if (r->suppressed)
+		n += sprintf(out + n, " (%d similar messages suppressed)", r->suppressed);
+	out[n++] = '\n';
+	return n;
+}
+
+/*取出所有就绪的记录并写出，返回处理的条数*/
+static int log_drain(void)
+{
+	/* 每条记录格式化后最长约为 4 * LOG_PAYLOAD + 128 字节 */
+	static char out[LOG_OUT_SIZE + 4 * LOG_PAYLOAD + 128];
+	unsigned long lost;
+	int n = 0, len = 0;
+
+	pthread_mutex_lock(&drain_lock);
+	for (;;) {
+		log_record *r = &ring[ring_tail & (LOG_SLOTS - 1)];
+		if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != ring_tail + 1)
+			break;
+		len += record_format(out + len, r);
+		/* 槽位留给下一圈的同一位置 */
+		__atomic_store_n(&r->seq, ring_tail + LOG_SLOTS, __ATOMIC_RELEASE);
+		ring_tail++;
+		n++;
+		if (len >= LOG_OUT_SIZE) {
+			write_all(out, len);
+			len = 0;
+		}
+	}
+	if ((lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED)) != 0)
+		len += sprintf(out + len, "log buffer full, %lu records dropped\n", lost);
+	if (len)
+		write_all(out, len);
+	pthread_mutex_unlock(&drain_lock);
+	return n;
+}
+
+/*缓冲区中是否有待写出的记录*/
+static int ring_pending(void)
+{
+	unsigned long tail = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+	return __atomic_load_n(&ring[tail & (LOG_SLOTS - 1)].seq, __ATOMIC_ACQUIRE) == tail + 1;
+}
+
+/*缓冲区为空时无超时地阻塞，直到生产者发布新记录*/
+static void *log_thread(void *arg)
+{
+	unsigned long long v;
+	(void)arg;
+	for (;;) {
+		if (log_drain() != 0)
+			continue;
+		__atomic_store_n(&log_sleeping, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		/* 设置标志前发布的记录不会触发唤醒，需要再检查一次 */
+		if (ring_pending()) {
+			if (__atomic_exchange_n(&log_sleeping, 0, __ATOMIC_RELAXED))
+				continue;
+			/* 标志已被生产者取走，它的通知会让下面的 read 立即返回 */
+		}
+		while (read(log_efd, &v, sizeof(v)) < 0 && errno == EINTR)
+			;
+	}
+	return NULL;
+}
+
+/*退出前写出缓冲区中剩余的记录*/
+void log_flush(void)
+{
+	if (log_ready)
+		log_drain();
+}
+
+/*名称（error/warn/info/debug）或数字，无法识别返回 -1*/
+int log_parse_level(const char *name)
+{
+	int i;
+	if (name[0] >= '0' && name[0] <= '9')
+		return atoi(name) > LOGL_DEBUG ? LOGL_DEBUG : atoi(name);
+	for (i = 0; i <= LOGL_DEBUG; i++) {
+		if (strcasecmp(name, level_names[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*启动后台写日志线程，fd 通常为标准输出*/
+int log_init(int level, int fd)
+{
+	pthread_t thread;
+	int i;
+
+	log_level = level;
+	log_fd = fd;
+	for (i = 0; i < LOG_SLOTS; i++)
+		ring[i].seq = i;
+	if ((log_efd = eventfd(0, EFD_CLOEXEC)) < 0)
+		return -1;
+	if (pthread_create(&thread, NULL, log_thread, NULL) != 0) {
+		close(log_efd);
+		log_efd = -1;
+		return -1;
+	}
+	pthread_detach(thread);
+	__atomic_store_n(&log_ready, 1, __ATOMIC_RELEASE);
+	atexit(log_flush);
+	return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef LOG_H
+#define LOG_H
+
+/* 日志级别，数值越大越详细 */
+#define LOGL_ERROR (0)
+#define LOGL_WARN (1)
+#define LOGL_INFO (2)
+#define LOGL_DEBUG (3)			/* 每条 AT 命令和应答 */
+
+#define LOG_SLOTS (1024)		/* 环形缓冲区记录数，必须是 2 的幂 */
+#define LOG_PAYLOAD (216)		/* 单条记录最多保存的字节数，超出的部分截断 */
+#define LOG_RATE (50)			/* 同一调用点每秒最多记录的条数，超出的只计数 */
+
+/* 调用点的限流状态，由日志宏定义为静态变量 */
+typedef struct _log_site
+{
+	unsigned long window;		/* 当前统计的秒 */
+	int count;
+	int suppressed;				/* 被限流丢弃、尚未报告的条数 */
+} log_site;
+
+extern int log_level;
+
+int log_parse_level(const char *name);
+int log_init(int level, int fd);
+void log_flush(void);
+void log_site_printf(log_site *site, int level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+void log_site_raw(log_site *site, int level, const char *tag, const void *data, int len, int total);
+
+/*
+ *  只在调用线程做一次拷贝（文本记录格式化后拷贝），不加锁、不调用系统调用；
+ *  时间格式化、转义和 write 都由后台线程完成，缓冲区满时丢弃并计数。
+ */
+#define log_printf(level, ...) do { \
+	static log_site _log_site; \
+	if ((level) <= log_level) \
+		log_site_printf(&_log_site, (level), __VA_ARGS__); \
+} while (0)
+
+/* 原始字节（AT 命令和应答），tag 必须是字符串常量，total 为数据总长度 */
+#define log_raw(level, tag, data, len, total) do { \
+	static log_site _log_site; \
+	if ((level) <= log_level) \
+		log_site_raw(&_log_site, (level), (tag), (data), (len), (total)); \
+} while (0)
+
+#define log_error(...) log_printf(LOGL_ERROR, __VA_ARGS__)
+#define log_warn(...) log_printf(LOGL_WARN, __VA_ARGS__)
+#define log_info(...) log_printf(LOGL_INFO, __VA_ARGS__)
+#define log_debug(...) log_printf(LOGL_DEBUG, __VA_ARGS__)
+
+#endif
@@ -21,20 +21,13 @@
 #include "openDev.h"
 #include "json.h"
 #include "tool.h"
-#include <sys/socket.h>
-#ifdef __linux__
-#include <sys/time.h>
-unsigned long long reckon_usec(void)
-{
-	struct timeval mstime;
-	unsigned long long us = 0;
-	gettimeofday(&mstime, NULL);
-	us = mstime.tv_sec * 1000000 + mstime.tv_usec;
-	return us;
-}
-#else 
-#define reckon_usec() 0
-#endif 
+#include "server.h"
+#include "serial.h"
+#include "modem.h"
+#include "atcmd.h"
+#include "metrics.h"
+#include "arena.h"
+#include "log.h"
 
 static struct termios save_tio;
 static int port = -1;
@@ -42,32 +35,62 @@ static const char* dev = "/dev/ttyUSB2";
 static const char* storage = "";
 static const char* dateformat = "%D %T";
 
-int fd;
-
 char *dev_name = "/dev/ttyUSB3";//根据实际情况选择串口
+static char *dev_names[MAX_MODEMS]; //每个 -d 一个模块，逗号分隔该模块的多个 AT 口
+static int ndev = 0;
+static char *discover = NULL; //-a 自动发现的设备匹配模式
+#define MAX_CLIENT_WEIGHTS (16)
+static struct { unsigned int addr; int weight; } client_weights[MAX_CLIENT_WEIGHTS]; //-c 指定的客户端权重
+static int nweights = 0;
 int PORT = 8888;
+int workers = 0; //网络线程数，0 表示按 CPU 核数
+
+/* ?timing=1 时记录的各阶段时间（单调时钟微秒），0 表示未经过该阶段 */
+typedef struct _req_timing
+{
+	unsigned long long accept; //连接建立
+	unsigned long long recv; //请求第一个字节到达，响应中的时间都相对于它
+	unsigned long long parsed; //请求解析完成
+	unsigned long long queue_enter; //进入串口队列
+	unsigned long long queue_exit; //开始在串口上执行
+	unsigned long long serial_write; //命令写完
+	unsigned long long first_byte; //收到模块第一个字节
+	unsigned long long final_code; //收到最终结果码
+	unsigned long long respond; //响应放入发送队列
+	unsigned long long sent; //响应发送完毕，只出现在日志中
+	int cached;
+	char cmd[48];
+} req_timing;
+
+/* HTTP 请求转换成的串口任务 */
+typedef struct _at_request
+{
+	conn_task task;
+	at_job job;
+	modem *md; //应答完成后更新该模块的缓存
+	at_flight flight; //相同只读命令合并执行
+	int leader; //实际提交到串口的请求，完成后应答所有跟随者
+	int retry; //准入控制拒绝时建议的重试秒数
+	int raw; //?raw=1 直接返回模块原始应答
+	unsigned long cache_gen; //提交时的缓存代数，期间缓存被清空则应答不写入缓存
+	req_timing *timing; //未要求计时为 NULL
+} at_request;
 #define _CRT_SECURE_NO_WARNINGS
-#define BUFFER_SIZE 4096
 
 
 static void usage()
 {
 	fprintf(stderr,
-		"usage: [options] send phoneNumber message\n"
-		"       [options] recv\n"
-		"       [options] delete msg_index | all\n"
-		"       [options] status\n"
-		"       [options] ussd code\n"
-		"       [options] at command\n"
+		"usage: ATTool_APIServer [options]\n"
 		"options:\n"
-		"\t-b <baudrate> (default: 115200)\n"
-		"\t-d <tty device> (default: /dev/ttyUSB0)\n"
-		"\t-D debug (for ussd and at)\n"
-		"\t-f <date/time format> (for sms/recv)\n"
-		"\t-j json output (for sms/recv)\n"
-		"\t-R use raw input (for ussd)\n"
-		"\t-r use raw output (for ussd and sms/recv)\n"
-		"\t-s <preferred storage> (for sms/recv/status)\n"
+		"\t-p <http port> (default: 8888)\n"
+		"\t-d <tty device>[,<tty device>...] (default: /dev/ttyUSB3)\n"
+		"\t   one modem per -d, comma separated AT ports of the same modem, first is primary\n"
+		"\t-a <device pattern> discover modems, e.g. '/dev/ttyUSB*', ports grouped by IMEI\n"
+		"\t-w <network threads> (default: number of CPUs)\n"
+		"\t-c <client ip>=<weight> share of the serial port against other clients (default: 1)\n"
+		"\t-m <response buffer limit in KB> (default: 512)\n"
+		"\t-l <log level> error|warn|info|debug (default: info, debug logs every AT command and response)\n"
 		);
 	exit(2);
 }
@@ -77,87 +100,430 @@ static void timeout()
 	exit(2);
 }
 
-int handle(int conn) {
+//JSON 写满当前窗口时交给连接：确认已写入的部分，再从发送队列取下一段空间
+static int json_flush_conn(json_buffer *buf, int needed) {
+	connection *conn = buf->arg;
+	conn_commit(conn, buf->end);
+	buf->end = 0;
+	if (needed == 0)
+		return 1;
+	buf->address = conn_reserve(conn, needed, &buf->size);
+	return buf->address != NULL;
+}
+
+//JSON 响应不再建树再序列化，由 json_writer 边转义边写入连接的发送队列；以 time 开头
+static void respond_begin(json_writer *w, connection *conn) {
+	json_writer_init(w, 1, json_flush_conn, conn);
+	if (conn_body_begin(conn) < 0)
+		w->error = 1;
+	json_write_begin_object(w, NULL);
+	json_write_int(w, "time", (long)time(NULL));
+}
+
+static int respond_end(json_writer *w, connection *conn) {
+	json_write_end_object(w);
+	//内存不足时响应不完整，发送后关闭连接
+	if (!json_write_finish(w))
+		conn->closing = 1;
+	return conn_body_end(conn, "200 OK", "application/json", NULL) < 0 ? -1 : HANDLE_DONE;
+}
+
+static int respond_code(connection *conn, const char *code, const char *at) {
+	json_writer w;
+	respond_begin(&w, conn);
+	json_write_string(&w, "Code", code);
+	json_write_string(&w, "AT", at);
+	return respond_end(&w, conn);
+}
+
+//串口线程中调用，把任务交回发起请求的网络线程
+static void at_complete(at_job *job) {
+	at_request *r = mpsc_entry(job, at_request, job);
+	conn_task_complete(&r->task);
+}
+
+//原始应答：分段直接放入发送队列，不拷贝，发送完释放引用
+static void respond_raw(connection *conn, at_resp *resp) {
+	at_seg *seg;
+	conn_respond(conn, resp->result == AT_RESULT_TIMEOUT ? "504 Gateway Timeout" :
+		resp->result == AT_RESULT_IO ? "502 Bad Gateway" : "200 OK", "text/plain", NULL, resp->len);
+	for (seg = resp->head; seg; seg = seg->next)
+		conn_send_ref(conn, seg->data, seg->len, at_resp_release, at_resp_ref(resp));
+}
+
+//?timing=1 或 X-Timing 请求头（非 0）时开始计时
+static req_timing *timing_begin(connection *conn, http_request *req, const char *cmd) {
+	http_slice v;
+	const http_slice *h = http_header_get(req, "X-Timing");
+	req_timing *tm;
+	if (http_query_get(req, "timing", &v))
+		h = &v;
+	if (!h || (h->len > 0 && h->p[0] == '0'))
+		return NULL;
+	if (!(tm = calloc(1, sizeof(req_timing))))
+		return NULL;
+	tm->accept = conn->t_accept;
+	tm->recv = conn->t_recv;
+	tm->parsed = conn->t_parsed;
+	snprintf(tm->cmd, sizeof(tm->cmd), "%s", cmd);
+	return tm;
+}
+
+//串口阶段的时间取自任务和应答，合并的请求共享同一次串口应答
+static void timing_serial(req_timing *tm, at_job *job, at_resp *resp) {
+	if (!tm) return;
+	tm->queue_enter = job->t_submit;
+	tm->queue_exit = job->t_start;
+	if (resp) {
+		tm->serial_write = resp->t_write;
+		tm->first_byte = resp->t_first;
+		tm->final_code = resp->t_final;
+	}
+}
+
+//相对于请求第一个字节的微秒数，keep-alive 连接的 accept 为负
+static long timing_offset(req_timing *tm, unsigned long long t) {
+	return t ? (long)(t - tm->recv) : -1;
+}
+
+static void timing_add(json_writer *w, req_timing *tm, const char *key, unsigned long long t) {
+	if (t)
+		json_write_int(w, key, timing_offset(tm, t));
+}
+
+//响应发送完毕（或连接关闭）后输出完整的计时日志
+static void timing_sent(void *arg) {
+	req_timing *tm = arg;
+	tm->sent = reckon_usec();
+	log_info("timing %s%s accept=%ld parsed=%ld queue=%ld..%ld write=%ld first=%ld final=%ld respond=%ld sent=%ld",
+		tm->cmd, tm->cached ? " (cached)" : "", timing_offset(tm, tm->accept), timing_offset(tm, tm->parsed),
+		timing_offset(tm, tm->queue_enter), timing_offset(tm, tm->queue_exit), timing_offset(tm, tm->serial_write),
+		timing_offset(tm, tm->first_byte), timing_offset(tm, tm->final_code), timing_offset(tm, tm->respond),
+		timing_offset(tm, tm->sent));
+	free(tm);
+}
+
+//串口应答或缓存的应答组装成响应，age 为缓存时间（毫秒），<0 表示刚从串口读取；tm 由本函数接管
+static void respond_resp(connection *conn, const char *cmd, at_resp *resp, int raw, long age, req_timing *tm) {
+	if (tm)
+		tm->respond = reckon_usec();
+	if (raw) {
+		respond_raw(conn, resp);
+		if (tm)
+			conn_on_sent(conn, timing_sent, tm);
+		return;
+	}
+	json_writer w;
+	at_seg *seg;
+	respond_begin(&w, conn);
+	//超过命令应答时间仍未收到最终结果码为 504，串口挂断为 502
+	json_write_string(&w, "Code", resp->result == AT_RESULT_TIMEOUT ? "504" : resp->result == AT_RESULT_IO ? "502" : "200");
+	json_write_string(&w, "AT", cmd);
+	//应答分段直接转义写入，不再拼接成一个字符串
+	json_write_string_begin(&w, "Result");
+	for (seg = resp->head; seg; seg = seg->next)
+		json_write_string_append(&w, seg->data, seg->len);
+	json_write_string_end(&w);
+	if (resp->truncated) //超过 -m 内存上限，应答不完整
+		json_write_bool(&w, "Truncated", JSON_TRUE);
+	if (age >= 0) //来自缓存
+		json_write_int(&w, "CacheAge", age);
+	if (tm) {
+		//各阶段相对于请求第一个字节的微秒数，缓存命中时没有串口阶段
+		json_write_begin_object(&w, "timing");
+		timing_add(&w, tm, "accept", tm->accept);
+		json_write_int(&w, "recv", 0);
+		timing_add(&w, tm, "parsed", tm->parsed);
+		timing_add(&w, tm, "queue_enter", tm->queue_enter);
+		timing_add(&w, tm, "queue_exit", tm->queue_exit);
+		timing_add(&w, tm, "serial_write", tm->serial_write);
+		timing_add(&w, tm, "first_byte", tm->first_byte);
+		timing_add(&w, tm, "final_code", tm->final_code);
+		timing_add(&w, tm, "respond", tm->respond);
+		if (tm->cached)
+			json_write_bool(&w, "cached", JSON_TRUE);
+		json_write_end_object(&w);
+	}
+	respond_end(&w, conn);
+	if (tm)
+		conn_on_sent(conn, timing_sent, tm);
+}
+
+//网络线程中调用，串口应答完成后组装响应
+static void at_respond(conn_task *t) {
+	at_request *r = mpsc_entry(t, at_request, task);
+	at_resp *resp = r->job.resp;
+	int ttl = at_cache_ttl(r->job.cmd);
+	at_flight *f, *next;
+	//同一次串口应答分发给所有合并的请求，各自回到所属网络线程应答
+	if (r->leader) {
+		for (f = flight_finish(&r->md->cache, &r->flight); f; f = next) {
+			at_request *fr = mpsc_entry(f, at_request, flight);
+			next = f->next;
+			fr->job.resp = resp ? at_resp_ref(resp) : NULL;
+			//加入时命令可能已在执行
+			fr->job.t_start = r->job.t_start > fr->job.t_submit ? r->job.t_start : fr->job.t_submit;
+			fr->retry = r->retry;
+			conn_task_complete(&fr->task);
+		}
+	}
+	//改变状态的命令使缓存失效；完整的成功应答写入缓存，即使连接已关闭，提交后缓存被清空过则不写入
+	if (resp && !at_is_readonly(r->job.cmd))
+		cache_clear(&r->md->cache);
+	else if (r->leader && ttl != 0 && resp && resp->result == AT_RESULT_OK && !resp->truncated)
+		cache_put(&r->md->cache, r->job.cmd, resp, ttl, r->cache_gen);
+	if (t->conn && !resp && r->retry) {
+		//串口排队已满或无法在期限内完成，立即拒绝而不是让客户端一直等待
+		char hdr[64];
+		snprintf(hdr, sizeof(hdr), "Retry-After: %d\r\n", r->retry);
+		conn_respond_ex(t->conn, "503 Service Unavailable", "text/plain", hdr, NULL, 0);
+	}
+	else if (t->conn && !resp)
+		conn_respond(t->conn, "500 Internal Server Error", "text/plain", NULL, 0);
+	else if (t->conn) {
+		timing_serial(r->timing, &r->job, resp);
+		respond_resp(t->conn, r->job.cmd, resp, r->raw, -1, r->timing);
+		r->timing = NULL;
+	}
+	free(r->timing);
+	at_resp_unref(resp);
+	free(r);
+}
+
+static void at_done(conn_task *t) {
+	arena_begin();
+	at_respond(t);
+	arena_end();
+}
+
+//客户端权重，未配置的客户端为 1
+static int client_weight(unsigned int addr) {
+	for (int i = 0; i < nweights; i++) {
+		if (client_weights[i].addr == addr)
+			return client_weights[i].weight;
+	}
+	return 1;
+}
+
+//任务优先级：?priority=high|normal|low 或 X-Priority 请求头，默认按命令分类
+static int request_priority(http_request *req, const char *cmd) {
+	http_slice v;
+	const http_slice *h = http_header_get(req, "X-Priority");
+	if (http_query_get(req, "priority", &v))
+		h = &v;
+	if (h && (slice_case_equal(h, "high") || slice_case_equal(h, "interactive")))
+		return AT_PRIO_INTERACTIVE;
+	if (h && slice_case_equal(h, "normal"))
+		return AT_PRIO_NORMAL;
+	if (h && (slice_case_equal(h, "low") || slice_case_equal(h, "background")))
+		return AT_PRIO_BACKGROUND;
+	return at_priority(cmd);
+}
 
-	int len = 0;
-	char buffer[BUFFER_SIZE];
-	char *pos = buffer;
-	bzero(buffer, BUFFER_SIZE);
-	len = recv(conn, buffer, BUFFER_SIZE, 0);
-	if (len <= 0 ) {
-		printf ("recv error");
+//请求期限（微秒）：?deadline=毫秒 或 X-Deadline 请求头，0 表示使用默认的排队时间上限
+static long request_deadline(http_request *req) {
+	http_slice v;
+	const http_slice *h = http_header_get(req, "X-Deadline");
+	if (http_query_get(req, "deadline", &v))
+		h = &v;
+	if (!h || h->len <= 0)
+		return 0;
+	return strtol(h->p, NULL, 10) * 1000;
+}
+
+//客户端允许的缓存时间（毫秒）：?nocache=1、?max-age=秒 或 Cache-Control 请求头；-1 表示不限制，0 表示绕过缓存
+static long cache_max_age(http_request *req) {
+	http_slice v;
+	const http_slice *cc;
+	const char *p, *end;
+	if (http_query_get(req, "nocache", NULL))
+		return 0;
+	if (http_query_get(req, "max-age", &v))
+		return v.len > 0 ? strtol(v.p, NULL, 10) * 1000 : 0;
+	cc = http_header_get(req, "Cache-Control");
+	if (!cc)
 		return -1;
-	} else {
-		// //printf("Debug request:\n--------------\n%s\n\n",buffer);
-		// 定义存放请求行、主机名等信息的变量
-		char method[10];
-		char path[100];
-		char protocol[10];
-		char hostname[100];
-		char useragent[100];
-		char acceptheader[100];
-		// 将requestHeader按换行符分隔为多行
-		int lineCount = 0;
-		for(const char *line = strtok((char*)buffer, "\r\n"); line != NULL; line = strtok(NULL, "\r\n")){
-			if(strlen(line)>0){
-				switch(lineCount++){
-					case 0: sscanf(line,"%s %[^ ]",method,path); break;
-					case 1: sscanf(line,"%s:%s",hostname,protocol); break;
-					case 2: sprintf(useragent,"%s",line); break;
-					case 3: sprintf(acceptheader,"%s",line); break;
-				}
-			}
+	end = cc->p + cc->len;
+	for (p = cc->p; p < end; p++) {
+		if (end - p >= 8 && (strncasecmp(p, "no-cache", 8) == 0 || strncasecmp(p, "no-store", 8) == 0))
+			return 0;
+		if (end - p > 8 && strncasecmp(p, "max-age=", 8) == 0)
+			return strtol(p + 8, NULL, 10) * 1000;
+	}
+	return -1;
+}
+
+//Prometheus 文本格式的指标
+static int respond_metrics(connection *conn) {
+	char *out = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&out, &len);
+	if (!f) return -1;
+	metrics_write(f);
+	fclose(f);
+	conn_respond(conn, "200 OK", "text/plain; version=0.0.4", out, (int)len);
+	free(out);
+	return HANDLE_DONE;
+}
+
+//单个模块各 AT 口的使用情况
+static void status_modem(json_writer *w, modem *md, unsigned long long now) {
+	serial_pool *pool = &md->pool;
+	json_write_begin_object(w, NULL);
+	json_write_int(w, "Index", md->id);
+	json_write_string(w, "IMEI", md->imei);
+	json_write_begin_array(w, "Channels");
+	for (int i = 0; i < pool->n; i++) {
+		serial_channel *ch = &pool->ch[i];
+		json_write_begin_object(w, NULL);
+		json_write_string(w, "Device", ch->dev);
+		json_write_int(w, "Jobs", (int)ch->jobs);
+		json_write_int(w, "Depth", __atomic_load_n(&ch->depth, __ATOMIC_RELAXED));
+		json_write_bool(w, "Busy", __atomic_load_n(&ch->busy, __ATOMIC_RELAXED));
+		//串口占用时间占运行时间的百分比
+		json_write_float(w, "Utilisation", now > pool->t_start ? 100.0 * ch->busy_usec / (now - pool->t_start) : 0);
+		json_write_int(w, "AvgWaitUs", ch->jobs ? (int)(ch->wait_usec / ch->jobs) : 0);
+		json_write_int(w, "BacklogUs", serial_wait(ch, AT_PRIO_CLASSES - 1));
+		json_write_int(w, "Rejected", (long)__atomic_load_n(&ch->rejected, __ATOMIC_RELAXED));
+		//各优先级的排队时间
+		json_write_begin_array(w, "Queues");
+		for (int p = 0; p < AT_PRIO_CLASSES; p++) {
+			at_sched *s = &ch->sched;
+			json_write_begin_object(w, NULL);
+			json_write_string(w, "Priority", at_prio_name(p));
+			json_write_int(w, "Jobs", (long)s->jobs[p]);
+			json_write_int(w, "AvgWaitUs", s->jobs[p] ? (long)(s->wait_usec[p] / s->jobs[p]) : 0);
+			json_write_int(w, "MaxWaitUs", (long)s->max_wait[p]);
+			json_write_end_object(w);
 		}
-		// printf("Method: %s\nPath: %s\nProtocol: %s\nHostname: %s\nUser Agent: %s\nAccept Header: %s\n", method, enstr, protocol, hostname, useragent, acceptheader);
-		//文件类型判断 
-		char enstr[1024] = {0};
-		decode_str(enstr, path);
-		char* suffix;
-		if ((suffix = strrchr(enstr, '/')) != NULL)
-			suffix = suffix + 1;
- 		if (strcmp(suffix, "favicon.ico") == 0){
+		json_write_end_array(w);
+		json_write_end_object(w);
+	}
+	json_write_end_array(w);
+	//应答缓存命中率
+	unsigned long hits = __atomic_load_n(&md->cache.hits, __ATOMIC_RELAXED);
+	unsigned long misses = __atomic_load_n(&md->cache.misses, __ATOMIC_RELAXED);
+	json_write_begin_object(w, "Cache");
+	json_write_int(w, "Hits", (long)hits);
+	json_write_int(w, "Misses", (long)misses);
+	json_write_int(w, "Coalesced", (long)__atomic_load_n(&md->cache.coalesced, __ATOMIC_RELAXED));
+	json_write_float(w, "HitRatio", hits + misses ? (double)hits / (hits + misses) : 0);
+	json_write_end_object(w);
+	json_write_end_object(w);
+}
+
+//only 为 NULL 时列出所有模块
+static int respond_status(connection *conn, modem *only) {
+	unsigned long long now = reckon_usec();
+	json_writer w;
+	respond_begin(&w, conn);
+	json_write_string(&w, "Code", "200");
+	json_write_begin_array(&w, "Modems");
+	for (int i = 0; i < modem_count(); i++) {
+		if (!only || only == modem_get(i))
+			status_modem(&w, modem_get(i), now);
+	}
+	json_write_end_array(&w);
+	return respond_end(&w, conn);
+}
+
+static int handle_request(connection *conn, http_request *req) {
 
+	// 请求行、请求头已由 http_parse 切分为指向接收缓冲区的片段，不再逐行拷贝
+	//文件类型判断 
+	char enstr[CONN_BUFF_SIZE];
+	decode_strn(enstr, sizeof(enstr), req->path.p, req->path.len);
+	char* suffix;
+	const char *rest;
+	//多模块时按 /modem/<IMEI 或序号>/ 前缀选择模块，没有前缀时使用第一个模块
+	modem *md = modem_route(enstr, &rest);
+	int prefixed = rest != enstr;
+	if ((suffix = strrchr(enstr, '/')) != NULL)
+		suffix = suffix + 1;
+	else
+		suffix = enstr;
+	if (strcmp(suffix, "favicon.ico") == 0){
+		conn_respond(conn, "404 Not Found", "text/plain", NULL, 0);
+	}
+	else if (!md){
+		return respond_code(conn, "404", "模块不存在");
+	}
+	else if (strcmp(suffix, "status") == 0){
+		return respond_status(conn, prefixed ? md : NULL);
+	}
+	else if (strcmp(suffix, "metrics") == 0){
+		return respond_metrics(conn);
+	}
+	else{
+
+		char *upper;
+		if(starts_with("AT",suffix) == 0 && starts_with("at",suffix) == 0 && starts_with("At",suffix) == 0 && starts_with("aT",suffix) == 0){
+			return respond_code(conn, "404", suffix);
 		}
-		else{
-
-			json_t json, t;
-			/* create root node */
-			json = json_create_object(NULL);
-			time_t currentTime;
-			currentTime = time(NULL);
-			json_add_int_to_object(json, "time", (long)currentTime);
-			char a[] ="HTTP/1.1 200 OK\r\nConnection: close\r\nAccept-Ranges: bytes\r\nContent-Type: application/json\r\n\r\n";
-			if(starts_with("AT",suffix) == 0 && starts_with("at",suffix) == 0 && starts_with("At",suffix) == 0 && starts_with("aT",suffix) == 0){
-				json_add_string_to_object(json, "Code", "404");
-				json_add_string_to_object(json, "AT", suffix);
-			}
-			else if (strstr(str_toupper(suffix), "AT+CMGL=") || strstr(str_toupper(suffix), "AT+CMGR="))
-			{
-				json_add_string_to_object(json, "Code", "404");
-				json_add_string_to_object(json, "AT", "不支持读取短信列表");
+		else if ((upper = str_toupper(suffix)) && (strstr(upper, "AT+CMGL=") || strstr(upper, "AT+CMGR=")))
+		{
+			return respond_code(conn, "404", "不支持读取短信列表");
+		}
+		else if (strlen(suffix) >= AT_CMD_SIZE)
+		{
+			return respond_code(conn, "414", "命令过长");
+		}
+		else
+		{
+			int raw = http_query_get(req, "raw", NULL);
+			long max_age, age;
+			//可缓存的只读命令先查缓存，命中时不经过串口
+			if (at_cache_ttl(suffix) != 0 && (max_age = cache_max_age(req)) != 0) {
+				at_resp *hit = cache_get(&md->cache, suffix, max_age, &age);
+				if (hit) {
+					req_timing *tm = timing_begin(conn, req, suffix);
+					if (tm)
+						tm->cached = 1;
+					respond_resp(conn, suffix, hit, raw, age, tm);
+					at_resp_unref(hit);
+					return HANDLE_DONE;
+				}
 			}
-			else
-			{
-				serial_parse phandle = SendAT(suffix);
-				json_add_string_to_object(json, "Code", "200");
-				json_add_string_to_object(json, "AT", suffix);
-				json_add_string_to_object(json, "Result", phandle.buff);
+			//交给串口线程执行，网络线程继续处理其他连接
+			at_request *r = calloc(1, sizeof(at_request));
+			if (!r) return -1;
+			strcpy(r->job.cmd, suffix);
+			r->md = md;
+			r->raw = raw;
+			r->timing = timing_begin(conn, req, suffix);
+			r->job.prio = request_priority(req, suffix);
+			r->job.client = conn->peer;
+			r->job.weight = client_weight(conn->peer);
+			r->job.complete = at_complete;
+			r->task.done = at_done;
+			conn_task_begin(conn, &r->task);
+			//相同的只读命令正在执行时直接等待其应答，不再占用串口
+			r->job.t_submit = reckon_usec(); //合并的请求从这里开始排队，提交到串口时重新记录
+			if (at_is_readonly(r->job.cmd) && flight_join(&md->cache, &r->flight, r->job.cmd))
+				return HANDLE_PENDING;
+			r->leader = 1;
+			r->cache_gen = cache_generation(&md->cache);
+			serial_channel *ch = serial_pick(&md->pool, r->job.cmd);
+			//准入控制：拒绝的请求也走任务完成流程，同时应答已合并进来的请求
+			if ((r->retry = serial_admit(ch, &r->job, request_deadline(req))) != 0) {
+				conn_task_complete(&r->task);
+				return HANDLE_PENDING;
 			}
-			char* out;
-			int len;
-			if (!json) return -1;
-			out = json_dumps(json, 0, 0, &len);
-			if (!out) return -1;
-			char *b = out;
-			char *cStr = strcat(a, b);
-			char result[strlen(cStr)];
-			strcpy(result, cStr);
-			send(conn, result, sizeof(result), 0);
-			//send(conn, (void *)result, sizeof(result), 0);
+			serial_submit(ch, &r->job);
+			return HANDLE_PENDING;
 		}
 	}
-	close(conn);
-	//关闭连接
+	return HANDLE_DONE;
+	//是否关闭连接由事件循环根据 keep-alive 决定
+}
+
+//应答在返回前已写入连接的发送队列，本次请求的临时字符串随 arena 一起释放
+int handle(connection *conn, http_request *req) {
+	int ret;
+	arena_begin();
+	ret = handle_request(conn, req);
+	arena_end();
+	return ret;
 }
 
 
@@ -215,53 +581,58 @@ int main(int argc,char *argv[]) {
 
 	// signal(SIGALRM,timeout);
 
-    //int fd;
-	PORT = 8888;
+	int ch, level = LOGL_INFO;
+	while ((ch = getopt(argc, argv, "p:d:a:w:c:m:l:h")) != -1){
+		switch (ch) {
+		case 'p': PORT = atoi(optarg); break;
+		case 'd':
+			if (ndev < MAX_MODEMS)
+				dev_names[ndev++] = optarg;
+			break;
+		case 'a': discover = optarg; break;
+		case 'w': workers = atoi(optarg); break;
+		case 'c': {
+			char *eq = strchr(optarg, '=');
+			if (!eq || nweights >= MAX_CLIENT_WEIGHTS)
+				usage();
+			*eq = '\0';
+			client_weights[nweights].addr = inet_addr(optarg);
+			client_weights[nweights].weight = atoi(eq + 1) > 0 ? atoi(eq + 1) : 1;
+			nweights++;
+			break;
+		}
+		case 'm': at_mem_set_limit(atol(optarg) * 1024); break;
+		case 'l':
+			if ((level = log_parse_level(optarg)) < 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	//日志由后台线程写出，串口和网络线程只写入环形缓冲区
+	if (log_init(level, STDOUT_FILENO) < 0)
+		fprintf(stderr, "create log thread error, logging synchronously\n");
+
     //dev_name = "/dev/ttyUSB2";//根据实际情况选择串口
-    fd = OpenDev(dev_name);
-
-    if(set_Parity(fd,8,1,'N')==FALSE) //设置校验位 
-    {
-        printf("Set Parity Error\n"); 
-        exit(1);
-    }
-    else
-    {
-        printf("Set Parity Success!\n"); 
-    }
-
-	struct sockaddr_in client_sockaddr;
-	struct sockaddr_in server_sockaddr;
-	int listenfd = socket(AF_INET,SOCK_STREAM,0);
-	int opt = 1;
-	int conn;
-	socklen_t length = sizeof(struct sockaddr_in);
-	setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(int));
-	server_sockaddr.sin_family = AF_INET;
-	server_sockaddr.sin_port = htons(PORT);
-	server_sockaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-	if(bind(listenfd,(struct sockaddr *)&server_sockaddr,sizeof(server_sockaddr))==-1) {
-		printf("bind error!\n");
+	if (ndev == 0 && !discover)
+		dev_names[ndev++] = dev_name;
+
+	//每个模块的每个 AT 口由独立线程独占，网络线程通过无锁队列提交命令
+	for (int i = 0; i < ndev; i++)
+		modem_add(dev_names[i]);
+	if (discover)
+		modem_discover(discover);
+	if (modem_count() == 0) {
+		log_error("no modem available");
 		return -1;
 	}
-	if(listen(listenfd, 10) < 0) {
-		printf("listen failed!\n");
+	//JSON 树和输出缓冲区从请求作用域的 arena 分配，见 handle / at_done
+	json_set_hooks(arena_malloc, arena_free, arena_realloc);
+	//epoll 事件循环，慢客户端或未发完的请求不再阻塞其他连接
+	if (server_run(PORT, workers, handle) < 0)
 		return -1;
-	}
-	while(1) {
-		conn = accept(listenfd, (struct sockaddr*)&client_sockaddr, &length);
-		if(conn < 0) {
-			printf("connect error!\n");
-			 sleep(1); 
-			continue;
-		}
-		if (handle(conn) < 0) {
-			printf("connect error!\n");
-			close(conn);
-			 sleep(1); 
-			continue;
-		}
-	}
-	close(fd);
 	return 0;
 }
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "metrics.h"
+
+server_metrics metrics;
+static pthread_mutex_t family_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *result_names[METRIC_RESULTS] = { "none", "ok", "error", "connect", "prompt", "timeout", "io_error" };
+static const char *prio_names[METRIC_PRIO_CLASSES] = { "interactive", "normal", "background" };
+
+/*v 落在第 i 桶：最小的满足 v <= 2^i 的 i，与输出的 le 上界一致；超出的归入最后一桶*/
+void hist_observe(metric_hist *h, unsigned long long v)
+{
+	int i = v > 1 ? 64 - __builtin_clzll(v - 1) : 0;
+	if (i >= HIST_BUCKETS)
+		i = HIST_BUCKETS - 1;
+	__atomic_add_fetch(&h->bucket[i], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->sum, v, __ATOMIC_RELAXED);
+}
+
+/*
+ *  命令族：命令名（= 或 ? 之前的部分）加类型，如 AT+COPS=?、AT+COPS?、AT+COPS=。
+ *  查找不加锁，新命令族在锁内追加，写好名字后再发布数量；超过 MAX_FAMILIES 的归入 other。
+ */
+metric_hist *metrics_family(const char *at)
+{
+	char name[FAMILY_NAME_SIZE];
+	int i, n, len = 0;
+
+	for (; *at && *at != '=' && *at != '?' && len < FAMILY_NAME_SIZE - 3; at++)
+		name[len++] = toupper((unsigned char)*at);
+	if (at[0] == '=' && at[1] == '?')
+		name[len++] = '=', name[len++] = '?';
+	else if (*at == '=' || *at == '?')
+		name[len++] = *at;
+	name[len] = '\0';
+
+	n = __atomic_load_n(&metrics.nfamilies, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++) {
+		if (strcmp(metrics.families[i].name, name) == 0)
+			return &metrics.families[i].serial_usec;
+	}
+	pthread_mutex_lock(&family_lock);
+	n = metrics.nfamilies;
+	for (; i < n; i++) {
+		if (strcmp(metrics.families[i].name, name) == 0)
+			break;
+	}
+	if (i == n && n < MAX_FAMILIES) {
+		strcpy(metrics.families[n].name, name);
+		__atomic_store_n(&metrics.nfamilies, n + 1, __ATOMIC_RELEASE);
+	} else if (i == n) {
+		i = MAX_FAMILIES;
+	}
+	pthread_mutex_unlock(&family_lock);
+	return &metrics.families[i].serial_usec;
+}
+
+/*Prometheus 标签值中的 \ 和 " 需要转义*/
+static void escape_label(char *dst, int size, const char *s)
+{
+	int n = 0;
+	for (; *s && n < size - 2; s++) {
+		if (*s == '\\' || *s == '"')
+			dst[n++] = '\\';
+		dst[n++] = *s;
+	}
+	dst[n] = '\0';
+}
+
+/*按 Prometheus 直方图格式输出，scale 把内部单位换算成秒 / 字节*/
+static void write_hist(FILE *f, const char *name, const char *label, const char *value, const metric_hist *h, double scale)
+{
+	unsigned long cum = 0;
+	char lbl[96] = "";
+	int i;
+
+	if (label)
+		snprintf(lbl, sizeof(lbl), "%s=\"%s\",", label, value);
+	for (i = 0; i < HIST_BUCKETS - 1; i++) {
+		cum += __atomic_load_n(&h->bucket[i], __ATOMIC_RELAXED);
+		fprintf(f, "%s_bucket{%sle=\"%g\"} %lu\n", name, lbl, (double)(1ULL << i) * scale, cum);
+	}
+	cum += __atomic_load_n(&h->bucket[i], __ATOMIC_RELAXED);
+	fprintf(f, "%s_bucket{%sle=\"+Inf\"} %lu\n", name, lbl, cum);
+	if (label) {
+		lbl[strlen(lbl) - 1] = '\0';
+		fprintf(f, "%s_sum{%s} %g\n%s_count{%s} %lu\n", name, lbl, __atomic_load_n(&h->sum, __ATOMIC_RELAXED) * scale,
+			name, lbl, __atomic_load_n(&h->count, __ATOMIC_RELAXED));
+	} else {
+		fprintf(f, "%s_sum %g\n%s_count %lu\n", name, __atomic_load_n(&h->sum, __ATOMIC_RELAXED) * scale,
+			name, __atomic_load_n(&h->count, __ATOMIC_RELAXED));
+	}
+}
+
+static void write_counter(FILE *f, const char *name, const char *help, unsigned long v)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", name, help, name, name, v);
+}
+
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+/*输出所有指标（Prometheus 文本格式 0.0.4）*/
+void metrics_write(FILE *f)
+{
+	int i, n;
+
+	write_counter(f, "attool_http_requests_total", "HTTP requests parsed.", LOAD(metrics.requests));
+	fprintf(f, "# HELP attool_http_responses_total HTTP responses by status class.\n# TYPE attool_http_responses_total counter\n");
+	fprintf(f, "attool_http_responses_total{code=\"2xx\"} %lu\n", LOAD(metrics.status_2xx));
+	fprintf(f, "attool_http_responses_total{code=\"4xx\"} %lu\n", LOAD(metrics.status_4xx));
+	fprintf(f, "attool_http_responses_total{code=\"5xx\"} %lu\n", LOAD(metrics.status_5xx));
+	write_counter(f, "attool_http_parse_errors_total", "Malformed or oversized requests.", LOAD(metrics.parse_errors));
+	write_counter(f, "attool_rejected_total", "Requests shed by admission control.", LOAD(metrics.rejected));
+	write_counter(f, "attool_cache_hits_total", "Response cache hits.", LOAD(metrics.cache_hits));
+	write_counter(f, "attool_cache_misses_total", "Response cache misses.", LOAD(metrics.cache_misses));
+	write_counter(f, "attool_coalesced_total", "Requests merged into an identical in-flight command.", LOAD(metrics.coalesced));
+
+	fprintf(f, "# HELP attool_at_results_total Serial transactions by final result.\n# TYPE attool_at_results_total counter\n");
+	for (i = 0; i < METRIC_RESULTS; i++)
+		fprintf(f, "attool_at_results_total{result=\"%s\"} %lu\n", result_names[i], LOAD(metrics.at_results[i]));
+
+	fprintf(f, "# HELP attool_http_parse_seconds CPU time spent parsing a request.\n# TYPE attool_http_parse_seconds histogram\n");
+	write_hist(f, "attool_http_parse_seconds", NULL, NULL, &metrics.parse_nsec, 1e-9);
+	fprintf(f, "# HELP attool_queue_wait_seconds Time a serial job waited before it started.\n# TYPE attool_queue_wait_seconds histogram\n");
+	for (i = 0; i < METRIC_PRIO_CLASSES; i++)
+		write_hist(f, "attool_queue_wait_seconds", "priority", prio_names[i], &metrics.queue_usec[i], 1e-6);
+	fprintf(f, "# HELP attool_serial_first_byte_seconds Time from writing a command to its first response byte.\n# TYPE attool_serial_first_byte_seconds histogram\n");
+	write_hist(f, "attool_serial_first_byte_seconds", NULL, NULL, &metrics.first_byte_usec, 1e-6);
+	fprintf(f, "# HELP attool_serial_seconds Serial transaction time by command family.\n# TYPE attool_serial_seconds histogram\n");
+	n = __atomic_load_n(&metrics.nfamilies, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++) {
+		char name[FAMILY_NAME_SIZE * 2];
+		escape_label(name, sizeof(name), metrics.families[i].name);
+		write_hist(f, "attool_serial_seconds", "family", name, &metrics.families[i].serial_usec, 1e-6);
+	}
+	if (LOAD(metrics.families[MAX_FAMILIES].serial_usec.count))
+		write_hist(f, "attool_serial_seconds", "family", "other", &metrics.families[MAX_FAMILIES].serial_usec, 1e-6);
+	fprintf(f, "# HELP attool_response_bytes Size of HTTP responses.\n# TYPE attool_response_bytes histogram\n");
+	write_hist(f, "attool_response_bytes", NULL, NULL, &metrics.response_bytes, 1);
+}
@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+
+#define HIST_BUCKETS (32)		/* 按 2 的幂分桶，第 i 桶记录 (2^(i-1), 2^i] 的值 */
+#define MAX_FAMILIES (32)		/* 分别统计串口耗时的命令族，超出的归入 other */
+#define FAMILY_NAME_SIZE (24)
+#define METRIC_PRIO_CLASSES (3)	/* 与 AT_PRIO_CLASSES 一致 */
+#define METRIC_RESULTS (7)		/* 与 AT_RESULT_xxx 一致 */
+
+/* 无锁直方图，记录一次只需三次原子加 */
+typedef struct _metric_hist
+{
+	unsigned long bucket[HIST_BUCKETS];
+	unsigned long count;
+	unsigned long long sum;
+} metric_hist;
+
+/* 按命令族统计的串口总耗时 */
+typedef struct _metric_family
+{
+	char name[FAMILY_NAME_SIZE];
+	metric_hist serial_usec;
+} metric_family;
+
+/* 全局指标，各线程直接原子累加 */
+typedef struct _server_metrics
+{
+	unsigned long requests;
+	unsigned long status_2xx, status_4xx, status_5xx;
+	unsigned long parse_errors;				/* 400 / 413 / 431 */
+	unsigned long rejected;					/* 准入控制返回的 503 */
+	unsigned long cache_hits, cache_misses, coalesced;
+	unsigned long at_results[METRIC_RESULTS];
+	metric_hist parse_nsec;					/* 解析请求的 CPU 耗时 */
+	metric_hist queue_usec[METRIC_PRIO_CLASSES];
+	metric_hist first_byte_usec;			/* 写完命令到收到第一个字节 */
+	metric_hist response_bytes;
+	int nfamilies;
+	metric_family families[MAX_FAMILIES + 1];	/* 最后一个为 other */
+} server_metrics;
+
+extern server_metrics metrics;
+
+#define metric_inc(counter) __atomic_add_fetch(&(counter), 1, __ATOMIC_RELAXED)
+
+void hist_observe(metric_hist *h, unsigned long long v);
+metric_hist *metrics_family(const char *at);
+void metrics_write(FILE *f);
+
+#endif
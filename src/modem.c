@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <glob.h>
+#include <pthread.h>
+
+#include "modem.h"
+#include "log.h"
+
+#define MAX_PROBE (32)	/* 自动发现时最多探测的设备数 */
+
+static modem modems[MAX_MODEMS];
+static int nmodems = 0;
+
+/*从 AT+CGSN 应答中取出 IMEI（第一段 14~17 位数字）*/
+static void parse_imei(const char *text, char *imei)
+{
+	const char *p = text, *s;
+
+	imei[0] = '\0';
+	while (*p) {
+		if (!isdigit((unsigned char)*p)) {
+			p++;
+			continue;
+		}
+		for (s = p; isdigit((unsigned char)*p); p++)
+			;
+		if (p - s >= 14 && p - s < IMEI_SIZE) {
+			memcpy(imei, s, p - s);
+			imei[p - s] = '\0';
+			return;
+		}
+	}
+}
+
+/*在串口线程启动前直接读取 IMEI，不是 AT 口或没有应答时 imei 为空*/
+static void probe_imei(const char *dev, char *imei)
+{
+	char text[256];
+	at_resp *resp;
+	int fd;
+
+	imei[0] = '\0';
+	fd = OpenDev((char *)dev);
+	if (fd < 0)
+		return;
+	resp = at_resp_new();
+	if (resp) {
+		if (SendAT(fd, "AT+CGSN", resp) == AT_RESULT_OK) {
+			at_resp_copy(resp, text, sizeof(text));
+			parse_imei(text, imei);
+		}
+		at_resp_unref(resp);
+	}
+	close(fd);
+}
+
+/*添加一个模块，devs 为逗号分隔的 AT 口，第一个为主口*/
+int modem_add(const char *devs)
+{
+	modem *m;
+	char *list, *dev, *save = NULL;
+
+	if (nmodems >= MAX_MODEMS) {
+		log_warn("too many modems, ignore %s", devs);
+		return -1;
+	}
+	/* 设备名被串口线程长期引用，拷贝一份，至少打开一个口后不再释放 */
+	list = strdup(devs);
+	if (!list)
+		return -1;
+	m = &modems[nmodems];
+	m->id = nmodems;
+	cache_init(&m->cache);
+	for (dev = strtok_r(list, ",", &save); dev; dev = strtok_r(NULL, ",", &save)) {
+		if (m->pool.n == 0)
+			probe_imei(dev, m->imei);
+		serial_pool_add(&m->pool, dev);
+	}
+	if (m->pool.n == 0) {
+		free(list);
+		return -1;
+	}
+	log_info("modem %d: IMEI %s, %d AT port(s)", m->id, m->imei[0] ? m->imei : "unknown", m->pool.n);
+	nmodems++;
+	return 0;
+}
+
+typedef struct _probe
+{
+	char *dev;
+	char imei[IMEI_SIZE];
+	pthread_t thread;
+	int started;				/* 线程已创建，需要 join；创建失败时已在当前线程探测 */
+} probe;
+
+static void *probe_thread(void *arg)
+{
+	probe *pr = arg;
+	probe_imei(pr->dev, pr->imei);
+	return NULL;
+}
+
+/*
+ *  自动发现：并行探测匹配 pattern 的设备（如 /dev/ttyUSB*），
+ *  能应答 AT+CGSN 的口按 IMEI 归组，同一模块的多个 AT 口合并，编号最小的为主口。
+ */
+int modem_discover(const char *pattern)
+{
+	glob_t g;
+	probe pr[MAX_PROBE];
+	char devs[MAX_CHANNELS * 64];
+	int i, j, n, found = 0;
+
+	if (glob(pattern, 0, NULL, &g) != 0)
+		return 0;
+	n = g.gl_pathc < MAX_PROBE ? g.gl_pathc : MAX_PROBE;
+	for (i = 0; i < n; i++) {
+		pr[i].dev = strdup(g.gl_pathv[i]);
+		pr[i].imei[0] = '\0';
+		pr[i].started = pr[i].dev && pthread_create(&pr[i].thread, NULL, probe_thread, &pr[i]) == 0;
+		if (pr[i].dev && !pr[i].started)
+			probe_thread(&pr[i]);
+	}
+	for (i = 0; i < n; i++)
+		if (pr[i].started)
+			pthread_join(pr[i].thread, NULL);
+	globfree(&g);
+
+	for (i = 0; i < n; i++) {
+		if (!pr[i].imei[0])
+			continue;
+		devs[0] = '\0';
+		for (j = i; j < n; j++) {
+			if (strcmp(pr[j].imei, pr[i].imei) != 0)
+				continue;
+			if (devs[0])
+				strcat(devs, ",");
+			if (strlen(devs) + strlen(pr[j].dev) < sizeof(devs))
+				strcat(devs, pr[j].dev);
+			if (j != i)
+				pr[j].imei[0] = '\0';
+		}
+		if (modem_add(devs) == 0)
+			found++;
+	}
+	for (i = 0; i < n; i++)
+		free(pr[i].dev);
+	return found;
+}
+
+int modem_count(void)
+{
+	return nmodems;
+}
+
+modem *modem_get(int i)
+{
+	if (i < 0 || i >= nmodems)
+		return NULL;
+	return &modems[i];
+}
+
+/*
+ *  按路径前缀选择模块：/modem/<IMEI 或序号>/AT+CSQ，
+ *  rest 指向剩余部分；没有前缀时使用第一个模块，找不到模块返回 NULL。
+ */
+modem *modem_route(const char *path, const char **rest)
+{
+	const char *key, *end;
+	int i, len;
+
+	*rest = path;
+	if (strncmp(path, "/modem/", 7) != 0)
+		return modem_get(0);
+	key = path + 7;
+	end = strchr(key, '/');
+	if (!end)
+		end = key + strlen(key);
+	len = end - key;
+	*rest = end;
+	if (len == 0)
+		return NULL;
+	for (i = 0; i < nmodems; i++) {
+		if ((int)strlen(modems[i].imei) == len && strncmp(modems[i].imei, key, len) == 0)
+			return &modems[i];
+	}
+	for (i = 0; i < len; i++) {
+		if (!isdigit((unsigned char)key[i]))
+			return NULL;
+	}
+	return len < 4 ? modem_get(atoi(key)) : NULL;
+}
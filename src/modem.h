@@ -0,0 +1,25 @@
+#ifndef MODEM_H
+#define MODEM_H
+
+#include "serial.h"
+#include "cache.h"
+
+#define MAX_MODEMS (8)		/* 单个进程最多管理的模块数 */
+#define IMEI_SIZE (20)
+
+/* 一个 4G/5G 模块：自己的一组 AT 口和串口线程，与其他模块并行执行 */
+typedef struct _modem
+{
+	int id;
+	char imei[IMEI_SIZE];	/* 读取失败时为空串 */
+	serial_pool pool;
+	at_cache cache;			/* 只读命令的应答缓存 */
+} modem;
+
+int modem_add(const char *devs);
+int modem_discover(const char *pattern);
+int modem_count(void);
+modem *modem_get(int i);
+modem *modem_route(const char *path, const char **rest);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef MPSC_H
+#define MPSC_H
+
+#include <stddef.h>
+
+/*
+ *  无锁多生产者单消费者队列（侵入式，Vyukov 算法）
+ *  节点嵌入到任务结构体中，入队不分配内存；任意线程可以 push，只有一个线程 pop。
+ *  生产者正在入队的瞬间 pop 可能返回 NULL，消费者在生产者唤醒后重试即可。
+ */
+typedef struct _mpsc_node
+{
+	struct _mpsc_node *next;
+} mpsc_node;
+
+typedef struct _mpsc_queue
+{
+	mpsc_node *head;	/* 生产者入队位置 */
+	mpsc_node *tail;	/* 消费者出队位置 */
+	mpsc_node stub;
+} mpsc_queue;
+
+#define mpsc_entry(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline void mpsc_init(mpsc_queue *q)
+{
+	q->stub.next = NULL;
+	q->head = &q->stub;
+	q->tail = &q->stub;
+}
+
+static inline void mpsc_push(mpsc_queue *q, mpsc_node *n)
+{
+	mpsc_node *prev;
+	__atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+static inline mpsc_node *mpsc_pop(mpsc_queue *q)
+{
+	mpsc_node *tail = q->tail;
+	mpsc_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &q->stub) {
+		if (!next)
+			return NULL;
+		q->tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+		return NULL;	/* 生产者尚未完成链接 */
+	mpsc_push(q, &q->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+#endif
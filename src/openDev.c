@@ -7,41 +7,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <strings.h>
+#include <poll.h>
+#include <time.h>
 
 #include "openDev.h"
+#include "tool.h"
+#include "log.h"
 
 #define TRUE 1
 #define FALSE 0
  
 int speed_arr[] = { B38400, B19200, B9600, B4800, B2400, B1200, B300, B38400, B19200, B9600, B4800, B2400, B1200, B300, };
 int name_arr[] = {38400, 19200, 9600, 4800, 2400, 1200, 300, 38400, 19200, 9600, 4800, 2400, 1200, 300, };
-int fd =-1;
-FILE* pf;// = fdopen(fd, "w");
-FILE* pfi;// = fdopen(fd, "r");
 char *ATb = "\r\n";
 
+static unsigned long long now_msec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 int OpenDev(char *Dev)
 {
  // , O_RDWR|O_NOCTTY
-  fd = open(Dev,O_RDWR | O_NOCTTY | O_NONBLOCK);
+  //多个模块的 AT 口可能同时打开，不再使用全局 fd
+  int fd = open(Dev,O_RDWR | O_NOCTTY | O_NONBLOCK);
   if(-1 == fd)
     {
-      perror("Can't Open Serial PPPPort");
+      log_error("Can't Open Serial PPPPort %s: %s", Dev, strerror(errno));
       return -1;
     } else {
       // printf("Open com success!\n");
       set_speed(fd,152000); //设置波特率
       if(set_Parity(fd,8,1,'N')==FALSE) //设置校验位 
       {
-          printf("Set Parity Error\n"); 
-          exit(1);
+          log_error("Set Parity Error");
+          close(fd);
+          return -1;
       }
       else
       {
-          printf("Set Parity Success!\n"); 
+          log_debug("Set Parity Success!");
       }
-      pf = fdopen(fd, "w");
-			pfi = fdopen(fd, "r");
       return fd;
     }
 } 
@@ -60,7 +69,7 @@ void set_speed(int fd, int speed)
           cfsetispeed(&Opt, speed_arr[i]);
          cfsetospeed(&Opt, speed_arr[i]);
          status = tcsetattr(fd, TCSANOW, &Opt); 
-          if (status != 0) perror("tcsetattr fd1");
+          if (status != 0) log_error("tcsetattr fd1: %s", strerror(errno));
          return;
        } 
     tcflush(fd,TCIOFLUSH);
@@ -72,7 +81,7 @@ int set_Parity(int fd,int databits,int stopbits,int parity)
   struct termios options; 
   if ( tcgetattr( fd,&options) != 0) 
   {
-   perror("SetupSerial 1");
+   log_error("SetupSerial 1: %s", strerror(errno));
    return(FALSE);
  } 
   bzero(&options,sizeof(options)); 
@@ -86,7 +95,7 @@ int set_Parity(int fd,int databits,int stopbits,int parity)
    case 8:
    options.c_cflag |= CS8;
    break; 
-    default: fprintf(stderr,"Unsupported data size\n");
+    default: log_error("Unsupported data size");
    return (FALSE); 
   } 
   switch (parity) 
@@ -112,7 +121,7 @@ int set_Parity(int fd,int databits,int stopbits,int parity)
     options.c_cflag &= ~PARENB; 
     options.c_cflag &= ~CSTOPB;
    break;
-   default: fprintf(stderr,"Unsupported parity\n"); 
+   default: log_error("Unsupported parity");
    return (FALSE); 
   } 
   switch (stopbits)
@@ -123,7 +132,7 @@ int set_Parity(int fd,int databits,int stopbits,int parity)
     case 2: 
     options.c_cflag |= CSTOPB;
    break; 
-    default: fprintf(stderr,"Unsupported stop bits\n"); 
+    default: log_error("Unsupported stop bits");
     return (FALSE); 
     } 
     if (parity != 'n') 
@@ -133,29 +142,201 @@ int set_Parity(int fd,int databits,int stopbits,int parity)
    tcflush(fd,TCIFLUSH); 
     if (tcsetattr(fd,TCSANOW,&options) != 0)
    {  
-        perror("SetupSerial 3"); 
+        log_error("SetupSerial 3: %s", strerror(errno));
         return (FALSE);
    } 
     return (TRUE);
 }
 
 
-serial_parse SendAT(char *at){
-  serial_parse phandle;
-  phandle.rxbuffsize = 0;
-  if(fd<0){
-    perror("Can't Open Serial PPPPort");
-    return phandle;
+/* 最终结果码，收到任意一个表示命令结束 */
+static const struct {
+  const char *code;
+  int result;
+} final_codes[] = {
+  { "OK", AT_RESULT_OK },
+  { "ERROR", AT_RESULT_ERROR },
+  { "+CME ERROR:", AT_RESULT_ERROR },
+  { "+CMS ERROR:", AT_RESULT_ERROR },
+  { "NO CARRIER", AT_RESULT_ERROR },
+  { "NO DIALTONE", AT_RESULT_ERROR },
+  { "NO ANSWER", AT_RESULT_ERROR },
+  { "BUSY", AT_RESULT_ERROR },
+  { "ABORTED", AT_RESULT_ERROR },
+  { "CONNECT", AT_RESULT_CONNECT },
+  { NULL, 0 }
+};
+
+/* 各命令最长应答时间（毫秒），按前缀匹配，先匹配先用；取自模块 AT 手册 */
+static const struct {
+  const char *prefix;
+  int timeout;
+} at_timeouts[] = {
+  { "AT+COPS?", AT_DEFAULT_TIMEOUT },
+  { "AT+COPS", 180000 },
+  { "AT+QSCAN", 180000 },
+  { "AT+CGATT", 140000 },
+  { "AT+CGACT", 150000 },
+  { "AT+CMGS", 120000 },
+  { "AT+CFUN", 15000 },
+  { "AT+QPOWD", 60000 },
+  { "ATD", 60000 },
+  { "ATH", 90000 },
+  { NULL, 0 }
+};
+
+int at_timeout(const char *at)
+{
+  int i;
+  for (i = 0; at_timeouts[i].prefix; i++) {
+    if (strncasecmp(at, at_timeouts[i].prefix, strlen(at_timeouts[i].prefix)) == 0)
+      return at_timeouts[i].timeout;
+  }
+  return AT_DEFAULT_TIMEOUT;
+}
+
+/* 判断一行是否为最终结果码 */
+static int final_line(const char *line, int len)
+{
+  int i, n;
+  /* 短信输入提示符 "> " 也表示模块等待下一步，不再有结果码 */
+  if (len >= 1 && line[0] == '>')
+    return AT_RESULT_PROMPT;
+  for (i = 0; final_codes[i].code; i++) {
+    n = strlen(final_codes[i].code);
+    if (len < n || strncmp(line, final_codes[i].code, n) != 0)
+      continue;
+    /* "OK" 等必须整行匹配，带冒号的错误码后面跟原因 */
+    if (len == n || final_codes[i].code[n - 1] == ':' || line[n] == ' ')
+      return final_codes[i].result;
+  }
+  return AT_RESULT_NONE;
+}
+
+/* 按行识别最终结果码，只保留每行开头几个字符，与应答如何分段无关 */
+typedef struct _at_framer
+{
+  char line[16];
+  int len;
+} at_framer;
+
+static int frame_feed(at_framer *f, const char *p, int n)
+{
+  int i, ret;
+  for (i = 0; i < n; i++) {
+    if (p[i] == '\r' || p[i] == '\n') {
+      if (f->len > 0 && (ret = final_line(f->line, f->len)) != AT_RESULT_NONE)
+        return ret;
+      f->len = 0;
+      continue;
+    }
+    if (f->len < (int)sizeof(f->line))
+      f->line[f->len] = p[i];
+    f->len++;
   }
-  char *ATcStr = strcat(at, ATb);
-  fputs(ATcStr, pf);
-  int nread;
-  printf("%s",ATcStr);
-  usleep(10000);
-  nread = read(fd , phandle.buff + phandle.rxbuffsize, MAX_BUFF_SIZE - phandle.rxbuffsize);
-  phandle.rxbuffsize += nread;
-  phandle.buff[phandle.rxbuffsize] = '\0';
-  printf("%s",phandle.buff);
-  return phandle;
+  /* 提示符后面没有换行 */
+  if (f->len > 0 && f->line[0] == '>')
+    return AT_RESULT_PROMPT;
+  return AT_RESULT_NONE;
 }
 
+static int write_all(int fd, const char *data, int len, int timeout)
+{
+  struct pollfd pfd = { fd, POLLOUT, 0 };
+  int n;
+  while (len > 0) {
+    n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN || poll(&pfd, 1, timeout) <= 0)
+        return -1;
+      continue;
+    }
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * 发送 AT 命令并把应答读入 resp，直到收到最终结果码或超过该命令的应答时间。
+ * 应答一到立即返回，不再固定等待；应答长度只受应答缓冲区内存上限限制。
+ */
+int SendAT(int fd, const char *at, at_resp *resp){
+  at_framer framer;
+  struct pollfd pfd;
+  unsigned long long deadline, now;
+  char discard[256], *space, last = 0, lf;
+  int nread, size;
+
+  resp->result = AT_RESULT_NONE;
+  framer.len = 0;
+  if(fd<0){
+    log_error("Can't Open Serial PPPPort");
+    return resp->result;
+  }
+  char ATcStr[strlen(at) + strlen(ATb) + 1]; //不修改调用方的命令
+  sprintf(ATcStr, "%s%s", at, ATb);
+  tcflush(fd, TCIFLUSH); //丢弃上一条超时命令的残留应答
+  log_raw(LOGL_DEBUG, "AT>", at, strlen(at), strlen(at)); //只拷贝到日志缓冲区，不阻塞串口收发
+  deadline = now_msec() + at_timeout(at);
+  if (write_all(fd, ATcStr, strlen(ATcStr), AT_DEFAULT_TIMEOUT) < 0) {
+    log_error("write serial: %s", strerror(errno));
+    resp->result = AT_RESULT_TIMEOUT;
+    return resp->result;
+  }
+  resp->t_write = reckon_usec();
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (resp->result == AT_RESULT_NONE) {
+    now = now_msec();
+    if (now >= deadline) {
+      resp->result = AT_RESULT_TIMEOUT;
+      break;
+    }
+    if (poll(&pfd, 1, (int)(deadline - now)) <= 0)
+      continue;
+    /* 挂断后 poll 一直返回 POLLHUP，不能继续等到期限，否则串口线程空转 */
+    if (!(pfd.revents & POLLIN) && (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))) {
+      log_error("serial hang up (revents 0x%x)", pfd.revents);
+      resp->result = AT_RESULT_IO;
+      break;
+    }
+    /* 直接读入应答分段；超过内存上限后继续读取并丢弃，只为等到结果码 */
+    space = at_resp_space(resp, &size);
+    if (!space) {
+      space = discard;
+      size = sizeof(discard);
+    }
+    nread = read(fd, space, size);
+    if (nread < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (nread <= 0) {
+      log_error("read serial: %s", nread < 0 ? strerror(errno) : "end of file");
+      resp->result = AT_RESULT_IO;
+      break;
+    }
+    if (!resp->t_first)
+      resp->t_first = reckon_usec();
+    if (space != discard)
+      at_resp_commit(resp, nread);
+    resp->result = frame_feed(&framer, space, nread);
+    last = space[nread - 1];
+  }
+  /* 结果码的 \r 和 \n 分开到达时读走 \n，否则它会出现在下一条命令应答的开头 */
+  if (resp->result != AT_RESULT_TIMEOUT && resp->result != AT_RESULT_IO && resp->result != AT_RESULT_PROMPT && last == '\r' &&
+      poll(&pfd, 1, AT_LF_WAIT) > 0 && read(fd, &lf, 1) == 1) {
+    if ((space = at_resp_space(resp, &size)) != NULL) {
+      *space = lf;
+      at_resp_commit(resp, 1);
+    }
+  }
+  resp->t_final = reckon_usec();
+  //整个应答记录一条，超出单条记录的部分只记长度
+  if (resp->head)
+    log_raw(LOGL_DEBUG, "AT<", resp->head->data, resp->head->len, resp->len);
+  else
+    log_debug("AT< (no response, result %d)", resp->result);
+  return resp->result;
+}
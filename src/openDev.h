@@ -2,19 +2,25 @@
 #define OPENDEV_H
 
 #include <math.h>
+#include "atbuf.h"
 
 #define TRUE 1
 #define FALSE 0
-#define MAX_BUFF_SIZE (256)
+#define AT_DEFAULT_TIMEOUT (5000) /* 未在超时表中的命令最长等待时间（毫秒） */
+#define AT_LF_WAIT (20)           /* 结果码只收到 \r 时等待 \n 的时间（毫秒） */
 
-typedef struct _serial_parse
-{
-    char buff[MAX_BUFF_SIZE];
-    int rxbuffsize;
-}serial_parse;
+/* 应答结果 */
+#define AT_RESULT_NONE (0)      /* 未收到最终结果码 */
+#define AT_RESULT_OK (1)        /* OK */
+#define AT_RESULT_ERROR (2)     /* ERROR / +CME ERROR / +CMS ERROR / NO CARRIER 等 */
+#define AT_RESULT_CONNECT (3)   /* CONNECT，进入数据模式 */
+#define AT_RESULT_PROMPT (4)    /* "> " 输入提示符 */
+#define AT_RESULT_TIMEOUT (5)   /* 超过命令应答时间 */
+#define AT_RESULT_IO (6)        /* 串口已挂断（拔出、伪终端主端关闭）或读出错 */
 
 int OpenDev(char *Dev);
 void set_speed(int fd, int speed);
 int set_Parity(int fd,int databits,int stopbits,int parity);
-serial_parse SendAT(char *at);
+int at_timeout(const char *at);
+int SendAT(int fd, const char *at, at_resp *resp);
 #endif
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/eventfd.h>
+
+#include "serial.h"
+#include "tool.h"
+#include "atcmd.h"
+#include "metrics.h"
+#include "log.h"
+
+/*命令族：去掉参数后的命令名加命令类型，如 AT+COPS=? 与 AT+COPS? 执行时间差别很大*/
+static unsigned int at_family(const char *at)
+{
+	unsigned int h = 2166136261u;
+	const char *p;
+	char kind = ' ';
+
+	for (p = at; *p && *p != '=' && *p != '?'; p++)
+		h = (h ^ (unsigned char)toupper((unsigned char)*p)) * 16777619u;
+	if (p[0] == '=' && p[1] == '?')
+		kind = 't';
+	else if (*p)
+		kind = *p;
+	return (h ^ (unsigned char)kind) * 16777619u;
+}
+
+/*串口线程中更新命令族和整体的执行时间滑动平均（权重 1/8）*/
+static void est_update(serial_channel *ch, unsigned int family, unsigned long long usec)
+{
+	unsigned int *e = &ch->est[family % EST_BUCKETS];
+	unsigned int v = usec > UINT_MAX ? UINT_MAX : (unsigned int)usec;
+
+	__atomic_store_n(e, *e ? (unsigned int)(((unsigned long long)*e * 7 + v) / 8) : v, __ATOMIC_RELAXED);
+	__atomic_store_n(&ch->est_all, ch->est_all ? (unsigned int)(((unsigned long long)ch->est_all * 7 + v) / 8) : v, __ATOMIC_RELAXED);
+}
+
+static const char *prio_names[AT_PRIO_CLASSES] = { "interactive", "normal", "background" };
+
+const char *at_prio_name(int prio)
+{
+	return prio >= 0 && prio < AT_PRIO_CLASSES ? prio_names[prio] : "unknown";
+}
+
+/*任务放入所属优先级中对应客户端的队列，新出现的客户端排到轮转链尾*/
+static void sched_push(at_sched *s, at_job *job)
+{
+	sched_class *c = &s->cls[job->prio];
+	unsigned int b = job->client % SCHED_BUCKETS;
+	sched_flow *f;
+
+	for (f = c->flows[b]; f && f->client != job->client; f = f->hnext)
+		;
+	if (!f) {
+		f = calloc(1, sizeof(sched_flow));
+		if (f) {
+			f->client = job->client;
+			f->hnext = c->flows[b];
+			c->flows[b] = f;
+		} else {
+			f = &c->spare;
+		}
+	}
+	if (!f->head) {
+		f->next = NULL;
+		if (c->active_tail)
+			c->active_tail->next = f;
+		else
+			c->active = f;
+		c->active_tail = f;
+	}
+	f->weight = job->weight > 0 ? job->weight : 1;
+	job->qnext = NULL;
+	if (f->tail)
+		f->tail->qnext = job;
+	else
+		f->head = job;
+	f->tail = job;
+	c->count++;
+}
+
+/*同一优先级中最早入队的任务的入队时间*/
+static unsigned long long class_oldest(sched_class *c)
+{
+	unsigned long long oldest = ULLONG_MAX;
+	sched_flow *f;
+	for (f = c->active; f; f = f->next) {
+		if (f->head->t_submit < oldest)
+			oldest = f->head->t_submit;
+	}
+	return oldest;
+}
+
+/*按权重轮转：轮到的客户端每轮最多执行 weight 个任务，然后排到链尾*/
+static at_job *class_pop(sched_class *c)
+{
+	sched_flow *f = c->active, **pf;
+	at_job *job;
+
+	if (f->deficit <= 0)
+		f->deficit += f->weight;
+	job = f->head;
+	f->head = job->qnext;
+	f->deficit--;
+	c->count--;
+	if (f->head && f->deficit > 0)
+		return job;
+	c->active = f->next;
+	if (!c->active)
+		c->active_tail = NULL;
+	if (f->head) {
+		f->next = NULL;
+		if (c->active_tail)
+			c->active_tail->next = f;
+		else
+			c->active = f;
+		c->active_tail = f;
+		return job;
+	}
+	/* 客户端已没有任务，释放其队列 */
+	f->tail = NULL;
+	f->deficit = 0;
+	if (f == &c->spare)
+		return job;
+	for (pf = &c->flows[f->client % SCHED_BUCKETS]; *pf != f; pf = &(*pf)->hnext)
+		;
+	*pf = f->hnext;
+	free(f);
+	return job;
+}
+
+/*
+ *  取出下一个要执行的任务：高优先级先执行；
+ *  低优先级的任务等待超过 AT_STARVE_USEC 时，等待最久的那一级先执行一个任务。
+ */
+static at_job *sched_pop(at_sched *s, unsigned long long now)
+{
+	unsigned long long oldest, wait = AT_STARVE_USEC;
+	int i, pick = -1;
+
+	for (i = 1; i < AT_PRIO_CLASSES; i++) {
+		if (!s->cls[i].count)
+			continue;
+		oldest = class_oldest(&s->cls[i]);
+		if (now > oldest && now - oldest > wait) {
+			wait = now - oldest;
+			pick = i;
+		}
+	}
+	for (i = 0; i < AT_PRIO_CLASSES && pick < 0; i++) {
+		if (s->cls[i].count)
+			pick = i;
+	}
+	return pick < 0 ? NULL : class_pop(&s->cls[pick]);
+}
+
+/*串口线程：按优先级逐个执行任务，保证同一个 tty 上的命令严格串行*/
+static void *serial_thread(void *arg)
+{
+	serial_channel *ch = arg;
+	at_sched *s = &ch->sched;
+	unsigned long long wait;
+	mpsc_node *n;
+	at_job *job;
+	uint64_t v;
+
+	for (;;) {
+		/* 取出无锁队列中的新任务，按优先级和客户端排队 */
+		while ((n = mpsc_pop(&ch->queue)) != NULL)
+			sched_push(s, mpsc_entry(n, at_job, node));
+		job = sched_pop(s, reckon_usec());
+		if (!job) {
+			/* 队列空，等待生产者唤醒 */
+			if (read(ch->efd, &v, sizeof(v)) < 0 && errno != EINTR)
+				break;
+			continue;
+		}
+		__atomic_sub_fetch(&ch->depth, 1, __ATOMIC_RELAXED);
+		/* 估计时间从排队移到执行中，准入控制按剩余时间计算 */
+		__atomic_store_n(&ch->running_start, reckon_usec(), __ATOMIC_RELAXED);
+		__atomic_store_n(&ch->running, job->estimate, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&ch->backlog[job->prio], job->estimate, __ATOMIC_RELAXED);
+		__atomic_store_n(&ch->busy, 1, __ATOMIC_RELAXED);
+		job->channel = ch;
+		job->t_start = reckon_usec();
+		job->resp = at_resp_new();
+		if (job->resp)
+			SendAT(ch->fd, job->cmd, job->resp);
+		job->t_done = reckon_usec();
+		/* 每个任务只有几次原子加 */
+		hist_observe(&metrics.queue_usec[job->prio], job->t_start - job->t_submit);
+		hist_observe(metrics_family(job->cmd), job->t_done - job->t_start);
+		if (job->resp) {
+			if (job->resp->t_first)
+				hist_observe(&metrics.first_byte_usec, job->resp->t_first - job->resp->t_write);
+			if (job->resp->result >= 0 && job->resp->result < METRIC_RESULTS)
+				metric_inc(metrics.at_results[job->resp->result]);
+		}
+		__atomic_store_n(&ch->busy, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&ch->running, 0, __ATOMIC_RELAXED);
+		est_update(ch, job->family, job->t_done - job->t_start);
+		ch->jobs++;
+		wait = job->t_start - job->t_submit;
+		ch->wait_usec += wait;
+		s->jobs[job->prio]++;
+		s->wait_usec[job->prio] += wait;
+		if (wait > s->max_wait[job->prio])
+			s->max_wait[job->prio] = wait;
+		ch->busy_usec += job->t_done - job->t_start;
+		job->complete(job);
+	}
+	return NULL;
+}
+
+int serial_start(serial_channel *ch, int fd)
+{
+	ch->fd = fd;
+	ch->depth = 0;
+	memset(&ch->sched, 0, sizeof(ch->sched));
+	mpsc_init(&ch->queue);
+	ch->efd = eventfd(0, EFD_CLOEXEC);
+	if (ch->efd < 0) {
+		log_error("eventfd: %s", strerror(errno));
+		return -1;
+	}
+	if (pthread_create(&ch->thread, NULL, serial_thread, ch) != 0) {
+		log_error("create serial thread error!");
+		close(ch->efd);
+		return -1;
+	}
+	return 0;
+}
+
+/*任意线程调用，只读取计数：prio 优先级的新任务预计的排队时间（微秒），即正在执行的剩余时间加上同级及更高优先级的积压*/
+long serial_wait(serial_channel *ch, int prio)
+{
+	long wait = 0, running = __atomic_load_n(&ch->running, __ATOMIC_RELAXED);
+	unsigned long long elapsed;
+	int i;
+
+	if (running > 0) {
+		elapsed = reckon_usec() - __atomic_load_n(&ch->running_start, __ATOMIC_RELAXED);
+		if ((unsigned long long)running > elapsed)
+			wait += running - elapsed;
+	}
+	for (i = 0; i <= prio && i < AT_PRIO_CLASSES; i++)
+		wait += __atomic_load_n(&ch->backlog[i], __ATOMIC_RELAXED);
+	return wait;
+}
+
+/*
+ *  准入控制：估计任务执行时间，排队已满或预计完成时间超过期限时拒绝。
+ *  deadline 为请求的期限（微秒），<=0 表示只限制排队时间不超过 AT_QUEUE_DEADLINE。
+ *  接受返回 0，拒绝返回建议的重试秒数。
+ */
+int serial_admit(serial_channel *ch, at_job *job, long deadline)
+{
+	unsigned int est;
+	long wait;
+
+	if (job->prio < 0 || job->prio >= AT_PRIO_CLASSES)
+		job->prio = AT_PRIO_NORMAL;
+	job->family = at_family(job->cmd);
+	est = __atomic_load_n(&ch->est[job->family % EST_BUCKETS], __ATOMIC_RELAXED);
+	if (!est)
+		est = __atomic_load_n(&ch->est_all, __ATOMIC_RELAXED);
+	job->estimate = est ? est : AT_EST_DEFAULT;
+	wait = serial_wait(ch, job->prio);
+	if (__atomic_load_n(&ch->depth, __ATOMIC_RELAXED) < AT_QUEUE_MAX
+		&& (deadline > 0 ? wait + job->estimate <= deadline : wait <= AT_QUEUE_DEADLINE))
+		return 0;
+	__atomic_add_fetch(&ch->rejected, 1, __ATOMIC_RELAXED);
+	metric_inc(metrics.rejected);
+	/* 按整个队列清空所需的时间建议重试 */
+	wait = serial_wait(ch, AT_PRIO_CLASSES - 1);
+	return wait / 1000000 + 1;
+}
+
+/*任意线程调用：任务入队并唤醒串口线程，完成后在串口线程调用 job->complete*/
+void serial_submit(serial_channel *ch, at_job *job)
+{
+	uint64_t one = 1;
+	job->t_submit = reckon_usec();
+	if (job->prio < 0 || job->prio >= AT_PRIO_CLASSES)
+		job->prio = AT_PRIO_NORMAL;
+	__atomic_add_fetch(&ch->backlog[job->prio], job->estimate, __ATOMIC_RELAXED);
+	job->depth = __atomic_fetch_add(&ch->depth, 1, __ATOMIC_RELAXED);
+	mpsc_push(&ch->queue, &job->node);
+	if (write(ch->efd, &one, sizeof(one)) < 0)
+		log_error("eventfd write: %s", strerror(errno));
+}
+
+/*打开一个 AT 口并启动其串口线程*/
+int serial_pool_add(serial_pool *p, const char *dev)
+{
+	serial_channel *ch;
+	int fd;
+
+	if (p->n >= MAX_CHANNELS) {
+		log_warn("too many AT ports, ignore %s", dev);
+		return -1;
+	}
+	fd = OpenDev((char *)dev);
+	if (fd < 0)
+		return -1;
+	ch = &p->ch[p->n];
+	ch->id = p->n;
+	ch->dev = dev;
+	if (serial_start(ch, fd) < 0) {
+		close(fd);
+		return -1;
+	}
+	if (p->n++ == 0)
+		p->t_start = reckon_usec();
+	return 0;
+}
+
+/*
+ *  选择执行命令的 AT 口：改变状态的命令固定走主口；
+ *  只读命令走预计排队时间最短的口，相同时优先用辅口，
+ *  这样网络扫描等长命令占用一个口时，AT+CSQ 之类的轮询仍可在其他口执行。
+ */
+serial_channel *serial_pick(serial_pool *p, const char *at)
+{
+	serial_channel *best = &p->ch[0];
+	long load, min;
+	int i;
+
+	if (p->n <= 1 || !at_is_readonly(at))
+		return best;
+	min = LONG_MAX;
+	for (i = p->n - 1; i >= 0; i--) {
+		load = serial_wait(&p->ch[i], AT_PRIO_CLASSES - 1);
+		if (load < min) {
+			min = load;
+			best = &p->ch[i];
+		}
+	}
+	return best;
+}
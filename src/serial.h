@@ -0,0 +1,117 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <pthread.h>
+#include "mpsc.h"
+#include "openDev.h"
+
+#define AT_CMD_SIZE (1024)	/* AT 命令最大长度（含追加的回车符） */
+#define MAX_CHANNELS (4)	/* 单个模块最多同时打开的 AT 口 */
+
+/* 优先级，数值越小越先执行 */
+#define AT_PRIO_INTERACTIVE (0)	/* 操作员触发的命令：重启、改 APN 等 */
+#define AT_PRIO_NORMAL (1)
+#define AT_PRIO_BACKGROUND (2)	/* 定时轮询的信号、身份信息 */
+#define AT_PRIO_CLASSES (3)
+#define AT_STARVE_USEC (2000000)	/* 低优先级任务等待超过该时间后优先执行，防止饿死 */
+#define SCHED_BUCKETS (32)
+
+/* 准入控制 */
+#define AT_QUEUE_MAX (64)			/* 单个 AT 口最多排队的任务数 */
+#define AT_QUEUE_DEADLINE (10000000)	/* 请求未指定期限时最长的预计排队时间（微秒） */
+#define AT_EST_DEFAULT (100000)		/* 没有历史数据时估计的命令执行时间（微秒） */
+#define EST_BUCKETS (64)
+
+struct _serial_channel;
+
+/* 串口任务：HTTP 工作线程提交，串口线程执行 */
+typedef struct _at_job
+{
+	mpsc_node node;						/* 串口队列节点 */
+	char cmd[AT_CMD_SIZE];
+	at_resp *resp;						/* 串口线程分配，提交方负责释放引用 */
+	int depth;							/* 入队时队列中已有的任务数 */
+	int prio;							/* AT_PRIO_xxx */
+	unsigned int client;				/* 同一客户端的任务按权重与其他客户端公平轮转 */
+	int weight;							/* 客户端权重，至少为 1 */
+	struct _at_job *qnext;				/* 调度队列中的下一个任务 */
+	unsigned int family;				/* 命令族哈希，用于估计执行时间 */
+	long estimate;						/* 估计的执行时间（微秒） */
+	unsigned long long t_submit;		/* 入队时间（微秒） */
+	unsigned long long t_start;			/* 串口线程开始处理的时间 */
+	unsigned long long t_done;			/* 串口应答完成的时间 */
+	struct _serial_channel *channel;	/* 执行该任务的 AT 口 */
+	void (*complete)(struct _at_job *job);	/* 在串口线程中调用，通知提交方 */
+} at_job;
+
+/* 同一优先级中一个客户端的任务队列 */
+typedef struct _sched_flow
+{
+	struct _sched_flow *next;			/* 轮转链 */
+	struct _sched_flow *hnext;			/* 按客户端查找的哈希链 */
+	unsigned int client;
+	int weight;
+	int deficit;						/* 本轮还可执行的任务数 */
+	at_job *head;
+	at_job *tail;
+} sched_flow;
+
+/* 一个优先级：各客户端按权重轮转（DRR） */
+typedef struct _sched_class
+{
+	sched_flow *active;
+	sched_flow *active_tail;
+	sched_flow *flows[SCHED_BUCKETS];
+	sched_flow spare;					/* 分配失败时所有客户端共用的队列 */
+	int count;
+} sched_class;
+
+/* 串口线程私有的调度队列，只在串口线程中访问 */
+typedef struct _at_sched
+{
+	sched_class cls[AT_PRIO_CLASSES];
+	unsigned long jobs[AT_PRIO_CLASSES];		/* 以下统计由串口线程写，其他线程只读 */
+	unsigned long long wait_usec[AT_PRIO_CLASSES];
+	unsigned long long max_wait[AT_PRIO_CLASSES];
+} at_sched;
+
+/* 独占一个 tty 的串口线程 */
+typedef struct _serial_channel
+{
+	int id;
+	const char *dev;
+	int fd;
+	int efd;							/* 唤醒串口线程的 eventfd */
+	pthread_t thread;
+	mpsc_queue queue;
+	at_sched sched;						/* 从无锁队列取出后按优先级和客户端排队 */
+	int depth;							/* 当前排队任务数 */
+	int busy;							/* 正在执行命令 */
+	unsigned long jobs;					/* 已完成任务数 */
+	unsigned long long wait_usec;		/* 累计排队时间 */
+	unsigned long long busy_usec;		/* 累计串口占用时间 */
+	long backlog[AT_PRIO_CLASSES];		/* 各优先级排队任务的估计执行时间之和，原子访问 */
+	long running;						/* 正在执行的任务的估计执行时间 */
+	unsigned long long running_start;
+	unsigned int est[EST_BUCKETS];		/* 各命令族执行时间的滑动平均（微秒），0 表示没有数据 */
+	unsigned int est_all;				/* 所有命令执行时间的滑动平均 */
+	unsigned long rejected;				/* 准入控制拒绝的请求数 */
+} serial_channel;
+
+/* 同一模块的多个 AT 口，第一个为主口，改变状态的命令只走主口以保证顺序 */
+typedef struct _serial_pool
+{
+	int n;
+	serial_channel ch[MAX_CHANNELS];
+	unsigned long long t_start;			/* 统计利用率的起点 */
+} serial_pool;
+
+const char *at_prio_name(int prio);
+int serial_start(serial_channel *ch, int fd);
+long serial_wait(serial_channel *ch, int prio);
+int serial_admit(serial_channel *ch, at_job *job, long deadline);
+void serial_submit(serial_channel *ch, at_job *job);
+int serial_pool_add(serial_pool *p, const char *dev);
+serial_channel *serial_pick(serial_pool *p, const char *at);
+
+#endif
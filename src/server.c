@@ -0,0 +1,628 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "server.h"
+#include "tool.h"
+#include "metrics.h"
+#include "log.h"
+
+#define EV_LISTEN ((void *)1)	/* epoll 数据：监听套接字 */
+#define EV_DONE ((void *)2)		/* epoll 数据：异步任务完成通知 */
+
+static server_worker workers[MAX_WORKERS];
+
+/*设置非阻塞*/
+static int set_nonblock(int sock)
+{
+	int flags = fcntl(sock, F_GETFL, 0);
+	if (flags < 0)
+		return -1;
+	return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+/*修改 epoll 关注的事件*/
+static void conn_watch(connection *c, int events)
+{
+	struct epoll_event ev;
+	if (c->events == events)
+		return;
+	ev.events = events;
+	ev.data.ptr = c;
+	epoll_ctl(c->worker->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->events = events;
+}
+
+static void conn_unlink(connection *c)
+{
+	server_worker *w = c->worker;
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		w->conns = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	else
+		w->conns_tail = c->prev;
+	c->prev = c->next = NULL;
+}
+
+static void conn_link(connection *c)
+{
+	server_worker *w = c->worker;
+	c->prev = NULL;
+	c->next = w->conns;
+	if (w->conns)
+		w->conns->prev = c;
+	else
+		w->conns_tail = c;
+	w->conns = c;
+}
+
+/*刷新活动时间，移到表头，超时扫描只需从表尾开始*/
+static void conn_touch(connection *c)
+{
+	c->active = time(NULL);
+	if (c->worker->conns != c) {
+		conn_unlink(c);
+		conn_link(c);
+	}
+}
+
+static out_chunk *chunk_add(connection *c, int size)
+{
+	out_chunk *o = malloc(sizeof(out_chunk) + size);
+	if (!o)
+		return NULL;
+	o->next = NULL;
+	o->len = o->off = 0;
+	o->size = size;
+	o->data = o->buf;
+	o->release = NULL;
+	o->arg = NULL;
+	if (c->out_tail)
+		c->out_tail->next = o;
+	else
+		c->out_head = o;
+	c->out_tail = o;
+	return o;
+}
+
+/*释放队首数据块*/
+static void chunk_free(connection *c)
+{
+	out_chunk *o = c->out_head;
+	c->out_head = o->next;
+	if (!c->out_head)
+		c->out_tail = NULL;
+	if (o->release)
+		o->release(o->arg);
+	free(o);
+}
+
+/*
+ *  同一批 epoll 事件中可能还有这个连接的事件（例如 do_done 中应答后关闭），
+ *  这里只关闭套接字并挂到 closed 表，fd 置为 -1，由 conn_reap 在这批事件处理完后释放
+ */
+static void conn_close(connection *c)
+{
+	server_worker *w = c->worker;
+
+	if (c->fd < 0)
+		return;
+	/* 异步任务仍在进行，完成后由任务自行释放 */
+	if (c->task)
+		c->task->conn = NULL;
+	epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+	conn_unlink(c);
+	w->nconns--;
+	while (c->out_head)
+		chunk_free(c);
+	c->next = w->closed;
+	w->closed = c;
+}
+
+/*释放已关闭的连接*/
+static void conn_reap(server_worker *w)
+{
+	connection *c;
+
+	while ((c = w->closed) != NULL) {
+		w->closed = c->next;
+		free(c);
+	}
+}
+
+/*关闭空闲超时的连接，等待异步任务的连接不算空闲*/
+static void conn_sweep(server_worker *w)
+{
+	time_t now = time(NULL);
+	while (w->conns_tail && now - w->conns_tail->active >= KEEPALIVE_TIMEOUT) {
+		if (w->conns_tail->task)
+			conn_touch(w->conns_tail);
+		else
+			conn_close(w->conns_tail);
+	}
+}
+
+/*把数据拷贝进发送队列，由事件循环负责发送*/
+int conn_send(connection *c, const char *data, int len)
+{
+	out_chunk *o = c->out_tail;
+	if (!o || !o->size || o->len + len > o->size) {
+		o = chunk_add(c, len > OUT_CHUNK_SIZE ? len : OUT_CHUNK_SIZE);
+		if (!o)
+			return -1;
+	}
+	memcpy(o->buf + o->len, data, len);
+	o->len += len;
+	return len;
+}
+
+/*不拷贝，直接引用外部数据，发送完成或连接关闭时调用 release(arg)*/
+int conn_send_ref(connection *c, const char *data, int len, void (*release)(void *arg), void *arg)
+{
+	out_chunk *o = chunk_add(c, 0);
+	if (!o) {
+		if (release)
+			release(arg);
+		return -1;
+	}
+	o->data = data;
+	o->len = len;
+	o->release = release;
+	o->arg = arg;
+	return len;
+}
+
+/*已排队的数据全部发出（或连接关闭）后调用 sent(arg)*/
+int conn_on_sent(connection *c, void (*sent)(void *arg), void *arg)
+{
+	return conn_send_ref(c, "", 0, sent, arg);
+}
+
+/*生成响应头并放入发送缓冲区，根据 keepalive 决定 Connection 头*/
+int conn_respond(connection *c, const char *status, const char *type, const char *body, int len)
+{
+	return conn_respond_ex(c, status, type, NULL, body, len);
+}
+
+/*生成响应头并计入指标，返回长度，超出 RESP_HEAD_SIZE 时返回 -1*/
+static int format_head(connection *c, char *head, const char *status, const char *type, const char *headers, int len)
+{
+	int n;
+
+	if (!headers)
+		headers = "";
+	if (!c->keepalive)
+		c->closing = 1;
+	if (c->closing)
+		n = snprintf(head, RESP_HEAD_SIZE, "HTTP/1.1 %s\r\nConnection: close\r\nAccept-Ranges: bytes\r\n"
+			"Content-Type: %s\r\n%sContent-Length: %d\r\n\r\n", status, type, headers, len);
+	else
+		n = snprintf(head, RESP_HEAD_SIZE, "HTTP/1.1 %s\r\nConnection: keep-alive\r\nKeep-Alive: timeout=%d, max=%d\r\n"
+			"Accept-Ranges: bytes\r\nContent-Type: %s\r\n%sContent-Length: %d\r\n\r\n",
+			status, KEEPALIVE_TIMEOUT, KEEPALIVE_MAX - c->nreq, type, headers, len);
+	if (n >= RESP_HEAD_SIZE)
+		return -1;
+	metric_inc(*(status[0] == '2' ? &metrics.status_2xx : status[0] == '4' ? &metrics.status_4xx : &metrics.status_5xx));
+	hist_observe(&metrics.response_bytes, n + len);
+	return n;
+}
+
+/*headers 为附加的响应头，每行以 \r\n 结尾，可为 NULL*/
+int conn_respond_ex(connection *c, const char *status, const char *type, const char *headers, const char *body, int len)
+{
+	char head[RESP_HEAD_SIZE];
+	int n;
+
+	if ((n = format_head(c, head, status, type, headers, len)) < 0)
+		return -1;
+	if (conn_send(c, head, n) < 0)
+		return -1;
+	/* body 为 NULL 时只发送响应头，响应体由调用方随后放入发送队列 */
+	if (body && len > 0 && conn_send(c, body, len) < 0)
+		return -1;
+	return n + len;
+}
+
+/*
+ *  流式应答：响应体由 conn_reserve / conn_commit 直接写入发送队列，
+ *  第一个数据块开头预留 RESP_HEAD_SIZE 字节，conn_body_end 时按实际长度把响应头紧贴响应体写入。
+ *  两次调用之间不能插入其他发送。
+ */
+int conn_body_begin(connection *c)
+{
+	out_chunk *o = chunk_add(c, RESP_HEAD_SIZE + OUT_CHUNK_SIZE);
+	if (!o)
+		return -1;
+	o->len = RESP_HEAD_SIZE;
+	c->body_chunk = o;
+	c->body_len = 0;
+	return 0;
+}
+
+/*返回发送队列尾部至少 need 字节的连续空间，*avail 为实际可用的长度*/
+char *conn_reserve(connection *c, int need, int *avail)
+{
+	out_chunk *o = c->out_tail;
+	if (!o || !o->size || o->size - o->len < need) {
+		o = chunk_add(c, need > OUT_CHUNK_SIZE ? need : OUT_CHUNK_SIZE);
+		if (!o)
+			return NULL;
+	}
+	*avail = o->size - o->len;
+	return o->buf + o->len;
+}
+
+/*确认 conn_reserve 的空间中已写入 len 字节*/
+void conn_commit(connection *c, int len)
+{
+	c->out_tail->len += len;
+	c->body_len += len;
+}
+
+int conn_body_end(connection *c, const char *status, const char *type, const char *headers)
+{
+	out_chunk *o = c->body_chunk;
+	char head[RESP_HEAD_SIZE];
+	int n;
+
+	if (!o)
+		return -1;
+	c->body_chunk = NULL;
+	if ((n = format_head(c, head, status, type, headers, c->body_len)) < 0)
+		return -1;
+	o->off = RESP_HEAD_SIZE - n;
+	memcpy(o->buf + o->off, head, n);
+	return n + c->body_len;
+}
+
+/*尽量发送队列中的数据，多个数据块合并成一次 sendmsg，返回 <0 表示连接已关闭*/
+static int conn_flush(connection *c)
+{
+	struct iovec iov[MAX_IOV];
+	struct msghdr msg;
+	out_chunk *o;
+	int i, n;
+
+	while (c->out_head) {
+		for (i = 0, o = c->out_head; o && i < MAX_IOV; o = o->next, i++) {
+			iov[i].iov_base = (char *)o->data + o->off;
+			iov[i].iov_len = o->len - o->off;
+		}
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = i;
+		n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				/* 待关闭或等待异步任务的连接不再读取新请求 */
+				conn_watch(c, (c->closing || c->task) ? EPOLLOUT : EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+				return 0;
+			}
+			conn_close(c);
+			return -1;
+		}
+		while (c->out_head) {
+			o = c->out_head;
+			if (n < o->len - o->off) {
+				o->off += n;
+				break;
+			}
+			n -= o->len - o->off;
+			chunk_free(c);
+		}
+	}
+	if (c->closing && !c->task) {
+		conn_close(c);
+		return -1;
+	}
+	/* 等待异步任务时暂停读取，流水线请求留在内核缓冲区 */
+	conn_watch(c, c->task ? 0 : EPOLLIN | EPOLLRDHUP);
+	return 0;
+}
+
+/*处理缓冲区内所有完整的请求（支持流水线），返回 <0 表示连接已关闭*/
+static int conn_process(connection *c)
+{
+	unsigned long long t;
+	int end, ret;
+
+	while (!c->closing && !c->task) {
+		t = reckon_nsec();
+		end = http_parse(&c->req, c->rbuf, c->rlen);
+		c->parse_nsec += reckon_nsec() - t;
+		if (end == HTTP_AGAIN) {
+			if (c->req.header_length && c->req.header_length + c->req.content_length > CONN_BUFF_SIZE) {
+				metric_inc(metrics.parse_errors);
+				c->keepalive = 0;
+				conn_respond(c, "413 Payload Too Large", "text/plain", NULL, 0);
+			} else if (c->rlen >= CONN_BUFF_SIZE) {
+				metric_inc(metrics.parse_errors);
+				c->keepalive = 0;
+				conn_respond(c, "431 Request Header Fields Too Large", "text/plain", NULL, 0);
+			}
+			break;
+		}
+		if (end < 0) {
+			metric_inc(metrics.parse_errors);
+			c->keepalive = 0;
+			if (end == HTTP_TOO_MANY)
+				conn_respond(c, "431 Request Header Fields Too Large", "text/plain", NULL, 0);
+			else
+				conn_respond(c, "400 Bad Request", "text/plain", NULL, 0);
+			break;
+		}
+		c->t_parsed = reckon_usec();
+		metric_inc(metrics.requests);
+		hist_observe(&metrics.parse_nsec, c->parse_nsec);
+		c->parse_nsec = 0;
+		c->nreq++;
+		c->keepalive = c->req.keepalive && c->nreq < KEEPALIVE_MAX;
+		ret = c->worker->handler(c, &c->req);
+		if (ret < 0) {
+			conn_close(c);
+			return -1;
+		}
+		if (!c->keepalive)
+			c->closing = 1;
+		/* 移走已处理的请求，后续流水线请求前移，解析器从头开始 */
+		c->rlen -= end;
+		if (c->rlen)	/* 流水线中的下一个请求已经到达 */
+			c->t_recv = reckon_usec();
+		memmove(c->rbuf, c->rbuf + end, c->rlen);
+		c->rbuf[c->rlen] = '\0';
+		http_reset(&c->req);
+	}
+	return conn_flush(c);
+}
+
+static void conn_read(connection *c)
+{
+	int n;
+
+	if (c->closing || c->task)
+		return;
+	conn_touch(c);
+	for (;;) {
+		if (c->rlen >= CONN_BUFF_SIZE)
+			return;
+		n = recv(c->fd, c->rbuf + c->rlen, CONN_BUFF_SIZE - c->rlen, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			conn_close(c);
+			return;
+		}
+		if (n == 0) {
+			/* 对端半关闭，发完已排队的响应再关闭 */
+			c->closing = 1;
+			conn_flush(c);
+			return;
+		}
+		if (!c->rlen)
+			c->t_recv = reckon_usec();
+		c->rlen += n;
+		c->rbuf[c->rlen] = '\0';
+		/* 增量解析，请求完整后交给上层处理 */
+		if (conn_process(c) < 0 || c->closing || c->task)
+			return;
+	}
+}
+
+/*在网络线程中登记异步任务，连接暂停处理后续请求*/
+void conn_task_begin(connection *c, conn_task *t)
+{
+	t->conn = c;
+	t->worker = c->worker;
+	c->task = t;
+}
+
+/*任意线程调用：把完成的任务交回所属网络线程*/
+void conn_task_complete(conn_task *t)
+{
+	uint64_t one = 1;
+	mpsc_push(&t->worker->done, &t->node);
+	if (write(t->worker->efd, &one, sizeof(one)) < 0)
+		log_error("eventfd write: %s", strerror(errno));
+}
+
+/*网络线程中处理已完成的异步任务：应答并继续处理流水线请求*/
+static void do_done(server_worker *w)
+{
+	mpsc_node *n;
+	conn_task *t;
+	connection *c;
+	uint64_t v;
+
+	if (read(w->efd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+		log_error("eventfd read: %s", strerror(errno));
+	while ((n = mpsc_pop(&w->done)) != NULL) {
+		t = mpsc_entry(n, conn_task, node);
+		c = t->conn;
+		if (c)
+			c->task = NULL;
+		t->done(t);
+		if (c) {
+			conn_touch(c);
+			if (conn_process(c) == 0 && !c->closing && c->rlen < CONN_BUFF_SIZE)
+				conn_read(c);
+		}
+	}
+}
+
+static void do_accept(server_worker *w)
+{
+	struct sockaddr_in client_sockaddr;
+	socklen_t length;
+	struct epoll_event ev;
+	connection *c;
+	int conn;
+
+	for (;;) {
+		length = sizeof(client_sockaddr);
+		conn = accept(w->listenfd, (struct sockaddr*)&client_sockaddr, &length);
+		if (conn < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log_error("accept error: %s", strerror(errno));
+			return;
+		}
+		set_nonblock(conn);
+		/* 响应总是整块放入发送队列，超过 MAX_IOV 的尾部不能因 Nagle 等待对端的延迟确认 */
+		setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &(int){ 1 }, sizeof(int));
+		c = calloc(1, sizeof(connection));
+		if (!c) {
+			close(conn);
+			continue;
+		}
+		c->fd = conn;
+		c->peer = client_sockaddr.sin_addr.s_addr;
+		c->worker = w;
+		c->events = EPOLLIN | EPOLLRDHUP;
+		ev.events = c->events;
+		ev.data.ptr = c;
+		if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, conn, &ev) < 0) {
+			close(conn);
+			free(c);
+			continue;
+		}
+		c->active = time(NULL);
+		c->t_accept = reckon_usec();
+		conn_link(c);
+		w->nconns++;
+	}
+}
+
+/*epoll 事件循环：本线程的监听套接字、客户端连接和任务完成通知复用同一线程*/
+static void *worker_loop(void *arg)
+{
+	server_worker *w = arg;
+	struct epoll_event events[MAX_EVENTS];
+	int i, n;
+
+	while (1) {
+		n = epoll_wait(w->epfd, events, MAX_EVENTS, 1000);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("epoll_wait error: %s", strerror(errno));
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			connection *c = events[i].data.ptr;
+			if (events[i].data.ptr == EV_LISTEN) {
+				do_accept(w);
+				continue;
+			}
+			if (events[i].data.ptr == EV_DONE) {
+				do_done(w);
+				continue;
+			}
+			if (c->fd < 0)	/* 已在这批事件中关闭 */
+				continue;
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				conn_close(c);
+				continue;
+			}
+			if (events[i].events & EPOLLOUT) {
+				if (conn_flush(c) < 0)
+					continue;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+				conn_read(c);
+		}
+		conn_reap(w);
+		conn_sweep(w);
+	}
+	return NULL;
+}
+
+static int worker_init(server_worker *w, int id, int port, request_handler handler)
+{
+	struct sockaddr_in server_sockaddr;
+	struct epoll_event ev;
+	int opt = 1;
+
+	w->id = id;
+	w->handler = handler;
+	mpsc_init(&w->done);
+	w->listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (w->listenfd < 0) {
+		log_error("socket error: %s", strerror(errno));
+		return -1;
+	}
+	setsockopt(w->listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(int));
+	/* 每个线程各自监听同一端口，由内核分配新连接 */
+	setsockopt(w->listenfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(int));
+	server_sockaddr.sin_family = AF_INET;
+	server_sockaddr.sin_port = htons(port);
+	server_sockaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(w->listenfd, (struct sockaddr *)&server_sockaddr, sizeof(server_sockaddr)) == -1) {
+		log_error("bind error: %s", strerror(errno));
+		return -1;
+	}
+	if (listen(w->listenfd, SOMAXCONN) < 0) {
+		log_error("listen failed: %s", strerror(errno));
+		return -1;
+	}
+	set_nonblock(w->listenfd);
+
+	w->epfd = epoll_create1(EPOLL_CLOEXEC);
+	w->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (w->epfd < 0 || w->efd < 0) {
+		log_error("epoll_create error: %s", strerror(errno));
+		return -1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = EV_LISTEN;
+	epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listenfd, &ev);
+	ev.events = EPOLLIN;
+	ev.data.ptr = EV_DONE;
+	epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->efd, &ev);
+	return 0;
+}
+
+/*启动 nworkers 个网络线程，当前线程作为第 0 个，不返回（出错返回 -1）*/
+int server_run(int port, int nworkers, request_handler handler)
+{
+	int i;
+
+	if (nworkers < 1)
+		nworkers = 1;
+	if (nworkers > MAX_WORKERS)
+		nworkers = MAX_WORKERS;
+	for (i = 0; i < nworkers; i++) {
+		if (worker_init(&workers[i], i, port, handler) < 0)
+			return -1;
+	}
+	for (i = 1; i < nworkers; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]) != 0) {
+			log_error("create worker thread error!");
+			return -1;
+		}
+	}
+	worker_loop(&workers[0]);
+	return -1;
+}
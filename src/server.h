@@ -0,0 +1,105 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <time.h>
+#include <pthread.h>
+#include "http.h"
+#include "mpsc.h"
+
+#define CONN_BUFF_SIZE (8192)	/* 单个连接接收缓冲区大小，即请求头 + 请求体最大长度 */
+#define MAX_EVENTS (64)			/* 每次 epoll_wait 取回的最大事件数 */
+#define MAX_WORKERS (16)		/* 网络工作线程上限 */
+#define KEEPALIVE_TIMEOUT (15)	/* 空闲连接超时（秒），也用于请求头未发完的慢客户端 */
+#define KEEPALIVE_MAX (100)		/* 单个连接最多处理的请求数 */
+#define OUT_CHUNK_SIZE (2048)	/* 发送队列自有数据块的最小容量 */
+#define RESP_HEAD_SIZE (512)	/* 响应头最大长度 */
+#define MAX_IOV (16)			/* 每次 sendmsg 最多合并的数据块 */
+
+#define HANDLE_DONE (0)			/* 请求已同步应答 */
+#define HANDLE_PENDING (1)		/* 请求已转为异步任务，完成后再应答 */
+
+struct _connection;
+struct _server_worker;
+
+/* 异步任务：可在任意线程完成，完成后回到连接所属的网络线程继续处理 */
+typedef struct _conn_task
+{
+	mpsc_node node;
+	struct _connection *conn;			/* 连接已关闭时为 NULL */
+	struct _server_worker *worker;
+	void (*done)(struct _conn_task *t);	/* 在网络线程中调用，负责应答并释放任务 */
+} conn_task;
+
+/* 发送队列中的一段数据：自有数据拷贝在 buf 中，外部数据只持有引用，发送完调用 release */
+typedef struct _out_chunk
+{
+	struct _out_chunk *next;
+	const char *data;
+	int len;
+	int off;						/* 已发送到的位置 */
+	int size;						/* 自有数据容量，外部数据为 0 */
+	void (*release)(void *arg);
+	void *arg;
+	char buf[];
+} out_chunk;
+
+typedef struct _connection
+{
+	int fd;
+	unsigned int peer;				/* 客户端 IPv4 地址（网络字节序） */
+	char rbuf[CONN_BUFF_SIZE + 1];	/* 接收缓冲区，末尾预留 '\0' */
+	int rlen;						/* 已接收字节数 */
+	http_request req;				/* 正在解析的请求，片段指向 rbuf */
+	out_chunk *out_head;			/* 待发送数据 */
+	out_chunk *out_tail;
+	out_chunk *body_chunk;			/* 正在流式写入的应答，开头预留了响应头 */
+	int body_len;					/* 已写入的响应体长度 */
+	int closing;					/* 发送完毕后关闭连接 */
+	int keepalive;					/* 当前请求是否保持连接 */
+	int nreq;						/* 已处理的请求数 */
+	time_t active;					/* 最后活动时间 */
+	unsigned long long parse_nsec;	/* 当前请求累计的解析耗时 */
+	unsigned long long t_accept;	/* 以下为单调时钟微秒：连接建立 */
+	unsigned long long t_recv;		/* 当前请求第一个字节到达 */
+	unsigned long long t_parsed;	/* 当前请求解析完成 */
+	int events;						/* 当前注册到 epoll 的事件 */
+	conn_task *task;				/* 进行中的异步任务 */
+	struct _server_worker *worker;
+	struct _connection *prev;
+	struct _connection *next;
+} connection;
+
+/* 收到完整请求后回调，req 中的片段在回调返回前有效；
+   返回 HANDLE_DONE / HANDLE_PENDING，返回 <0 时立即关闭连接 */
+typedef int (*request_handler)(connection *c, http_request *req);
+
+/* 网络工作线程，每个线程有独立的监听套接字（SO_REUSEPORT）和 epoll */
+typedef struct _server_worker
+{
+	int id;
+	int epfd;
+	int listenfd;
+	int efd;						/* 异步任务完成通知 */
+	mpsc_queue done;				/* 已完成的异步任务 */
+	request_handler handler;
+	pthread_t thread;
+	connection *conns;				/* 所有活动连接，按最后活动时间排序，最新的在表头 */
+	connection *conns_tail;
+	connection *closed;				/* 本轮事件中已关闭的连接，处理完这一批事件后再释放 */
+	int nconns;
+} server_worker;
+
+int server_run(int port, int nworkers, request_handler handler);
+int conn_send(connection *c, const char *data, int len);
+int conn_send_ref(connection *c, const char *data, int len, void (*release)(void *arg), void *arg);
+int conn_on_sent(connection *c, void (*sent)(void *arg), void *arg);
+int conn_respond(connection *c, const char *status, const char *type, const char *body, int len);
+int conn_respond_ex(connection *c, const char *status, const char *type, const char *headers, const char *body, int len);
+int conn_body_begin(connection *c);
+char *conn_reserve(connection *c, int need, int *avail);
+void conn_commit(connection *c, int len);
+int conn_body_end(connection *c, const char *status, const char *type, const char *headers);
+void conn_task_begin(connection *c, conn_task *t);
+void conn_task_complete(conn_task *t);
+
+#endif
@@ -1,4 +1,5 @@
 #include "tool.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -8,7 +9,23 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <ctype.h>
+#include <sys/time.h>
 
+/*单调时钟微秒数，用于统计耗时*/
+unsigned long long reckon_usec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/*单调时钟纳秒数，用于统计微秒以下的耗时*/
+unsigned long long reckon_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 /*字符包含判断*/
 int starts_with(const char* prefix, const char* str)
 {
@@ -33,22 +50,26 @@ int FileExist(const char* filename)
 char* str_tolower(const char* str)
 {
 	size_t len = strlen(str);
-    char *lower = calloc(len+1, sizeof(char));
+    //请求作用域内从 arena 分配，应答完成后统一回收
+    char *lower = arena_malloc(len+1);
+    if (!lower) return NULL;
     for (size_t i = 0; i < len; ++i) {
         lower[i] = tolower((unsigned char)str[i]);
     }
-	/*free(upper);*/
+    lower[len] = '\0';
 	return lower;
 }
 /*字符转大写*/
 char* str_toupper(const char* str)
 {
 	size_t len = strlen(str);
-    char *upper = calloc(len+1, sizeof(char));
+    //请求作用域内从 arena 分配，应答完成后统一回收
+    char *upper = arena_malloc(len+1);
+    if (!upper) return NULL;
     for (size_t i = 0; i < len; ++i) {
         upper[i] = toupper((unsigned char)str[i]);
     }
-	/*free(upper);*/
+    upper[len] = '\0';
 	return upper;
 }
 /*char*转char[]*/
@@ -102,7 +123,7 @@ void decode_str(char *to, char *from)
 {
     for ( ; *from != '\0'; ++to, ++from  )
     {
-        if (from[0] == '%' && isxdigit(from[1]) && isxdigit(from[2]))
+        if (from[0] == '%' && isxdigit((unsigned char)from[1]) && isxdigit((unsigned char)from[2]))
         {
  
             *to = hexit(from[1])*16 + hexit(from[2]);
@@ -118,16 +139,33 @@ void decode_str(char *to, char *from)
     }
     *to = '\0';
 }
+/*按长度解码，from 不需要以 '\0' 结尾，最多写入 tosize-1 个字符*/
+void decode_strn(char *to, int tosize, const char *from, int len)
+{
+    const char *end = from + len;
+    char *last = to + tosize - 1;
+
+    for ( ; from < end && to < last; ++to, ++from)
+    {
+        if (from[0] == '%' && end - from >= 3 && isxdigit((unsigned char)from[1]) && isxdigit((unsigned char)from[2]))
+        {
+            *to = hexit(from[1])*16 + hexit(from[2]);
+            from += 2;
+        }
+        else
+        {
+            *to = *from;
+        }
+    }
+    *to = '\0';
+}
 //字符向右查找实现截取内容
 int trim_dots(const char * path)
 {
     char *  pos = NULL;
     pos = strrchr(path, '/');
-    printf("%s\n", pos);
-
     if(pos == NULL)
     {
-        perror("strrchr");
         return -1;
     }
     if((strcmp(pos+1, ".") == 0) || (strcmp(pos+1, "..") == 0))
@@ -140,7 +178,8 @@ int trim_dots(const char * path)
 // 创建函数（方法一）：是否包含字符串函数
 int is_in(char *wenben, char *search_word)
 {
-    int i = 0, j = 0, flag = -1;
+    size_t i = 0, j = 0;
+    int flag = -1;
     while (i < strlen(wenben) && j < strlen(search_word))
     {
         if (wenben[i] == search_word[j])
@@ -1,3 +1,5 @@
+unsigned long long reckon_usec(void);
+unsigned long long reckon_nsec(void);
 
 
 int starts_with(const char* prefix, const char* str);
@@ -18,6 +20,7 @@ void encode_str(char* to, int tosize, const char* from);
 int hexit(char c);
 
 void decode_str(char *to, char *from);
+void decode_strn(char *to, int tosize, const char *from, int len);
 
 //字符向右查找实现截取内容
 int trim_dots(const char * path);